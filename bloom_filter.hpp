@@ -0,0 +1,176 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_BLOOM_FILTER_HPP
+#define ORIGIN_BLOOM_FILTER_HPP
+
+// A cache-line-blocked Bloom filter [1, 2]. Each key is mapped to a
+// single 64-byte block, and all of its bits are set within one 64-bit
+// word of that block, so a query costs one cache miss. All bit
+// positions are derived from a single 64-bit digest: the high half
+// selects the block and the word, and the low half is multiplied by 5
+// odd constants to select the bits in the word (k = 5).
+//
+// Since a key's bits share a word, an insert is a single OR, which is
+// a single atomic OR when inserting concurrently, and a query is a
+// single load and compare. The mask loop has a fixed trip count, so it
+// unrolls to a few multiplies, shifts and ORs. Keeping the bits in
+// one word costs some accuracy: about 1.8% false positives at 10 bits
+// per key, against about 1% with one bit in each of the 8 words.
+//
+// [1] F. Putze et al. Cache-, hash- and space-efficient Bloom filters.
+// WEA 2007.
+//
+// [2] H. Lang et al. Performance-optimal filtering: Bloom overtakes
+// cuckoo at high throughput. VLDB 2019.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+template<Hash_algorithm_64 H = fnv1a>
+class bloom_filter
+{
+public:
+  static constexpr std::size_t words = 8;
+  static constexpr std::size_t hashes = 5;
+
+  struct alignas(64) block
+  {
+    std::uint64_t w[words];
+  };
+
+  // Create a filter for about n keys with the given number of bits
+  // per key.
+  explicit bloom_filter(std::size_t n, double bits_per_key = 10, std::uint64_t seed = 0)
+    : blocks_(block_count(n, bits_per_key)), seed_(seed), hash_(H(seed))
+  { }
+
+  // Insert an object.
+  template<Hashable_with<H> T>
+  void insert(T const& t)
+  {
+    insert_digest(digest(t));
+  }
+
+  // Insert an object. This may be called concurrently with other calls
+  // to insert_concurrent() and contains().
+  template<Hashable_with<H> T>
+  void insert_concurrent(T const& t)
+  {
+    insert_digest_concurrent(digest(t));
+  }
+
+  // Returns true if the object may have been inserted, and false if it
+  // definitely has not.
+  template<Hashable_with<H> T>
+  bool contains(T const& t) const
+  {
+    return contains_digest(digest(t));
+  }
+
+  // Returns the digest of an object, as used by the filter.
+  template<Hashable_with<H> T>
+  std::uint64_t digest(T const& t) const
+  {
+    return hash_mix(hash_(t));
+  }
+
+  void insert_digest(std::uint64_t d)
+  {
+    word(d) |= mask(d);
+  }
+
+  void insert_digest_concurrent(std::uint64_t d)
+  {
+    __atomic_fetch_or(&word(d), mask(d), __ATOMIC_RELAXED);
+  }
+
+  // This may be called concurrently with insert_digest_concurrent().
+  bool contains_digest(std::uint64_t d) const
+  {
+    std::uint64_t m = mask(d);
+    return (__atomic_load_n(&word(d), __ATOMIC_RELAXED) & m) == m;
+  }
+
+  // Prefetch the block of a digest.
+  void prefetch(std::uint64_t d) const
+  {
+    __builtin_prefetch(&word(d));
+  }
+
+  // Insert the contents of another filter of the same size and seed.
+  void merge(bloom_filter const& x)
+  {
+    if (blocks_.size() != x.blocks_.size() || seed_ != x.seed_)
+      throw std::invalid_argument("bloom_filter: mismatched filters");
+    for (std::size_t i = 0; i < blocks_.size(); ++i)
+      for (std::size_t j = 0; j < words; ++j)
+        blocks_[i].w[j] |= x.blocks_[i].w[j];
+  }
+
+  void clear()
+  {
+    std::fill(blocks_.begin(), blocks_.end(), block{});
+  }
+
+  std::size_t size_in_bytes() const { return blocks_.size() * sizeof(block); }
+
+private:
+  static std::size_t block_count(std::size_t n, double bits_per_key)
+  {
+    double bits = std::ceil(n * bits_per_key);
+    std::size_t b = static_cast<std::size_t>(bits / (8 * sizeof(block))) + 1;
+    return b;
+  }
+
+  // Map the high half of the digest to a block in [0, size), and the
+  // fraction left over to a word in the block. Returns the index of the
+  // word among all words.
+  std::size_t slot(std::uint64_t d) const
+  {
+    std::uint64_t p = (d >> 32) * blocks_.size();
+    return (p >> 32) * words + (std::uint32_t(p) >> 29);
+  }
+
+  std::uint64_t& word(std::uint64_t d)
+  {
+    std::size_t s = slot(d);
+    return blocks_[s / words].w[s % words];
+  }
+
+  std::uint64_t const& word(std::uint64_t d) const
+  {
+    std::size_t s = slot(d);
+    return blocks_[s / words].w[s % words];
+  }
+
+  // Select the bits in the word from the low half of the digest.
+  static std::uint64_t mask(std::uint64_t d)
+  {
+    static constexpr std::uint32_t salt[hashes] = {
+      0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u
+    };
+    std::uint32_t x = static_cast<std::uint32_t>(d);
+    std::uint64_t m = 0;
+    for (std::size_t i = 0; i < hashes; ++i)
+      m |= std::uint64_t(1) << (std::uint32_t(x * salt[i]) >> 26);
+    return m;
+  }
+
+  std::vector<block> blocks_;
+  std::uint64_t seed_;
+  hash<H> hash_;
+};
+
+
+} // namespace origin
+
+
+#endif
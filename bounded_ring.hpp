@@ -0,0 +1,191 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_BOUNDED_RING_HPP
+#define ORIGIN_BOUNDED_RING_HPP
+
+// Consistent hashing with bounded loads [1].
+//
+// Each node is placed on a ring of 64-bit positions at several virtual
+// nodes, at the digests of (node, replica). A key belongs to the first
+// virtual node at or after its digest. With bounded loads, a key being
+// assigned skips the virtual nodes of any node whose load has reached
+// the capacity ceil((1 + epsilon) * m / n), where m is the number of
+// assigned keys (including the new one) and n the number of nodes. No
+// node then holds more than (1 + epsilon) times the average, however
+// skewed the keys are.
+//
+// The ring is stored as a sorted array of positions with a parallel
+// array of owners. Instead of a binary search, a lookup uses a flat
+// index on the high bits of the digest, with about one bucket per
+// virtual node, that gives the first virtual node in the bucket. The
+// forward walk then only reads the owners array and a per-node load.
+//
+// [1] V. Mirrokni, M. Thorup and M. Zadimoghaddam. Consistent hashing
+// with bounded loads. SODA 2018.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+template<Hash_algorithm_64 H = fnv1a>
+class bounded_load_ring
+{
+public:
+  // Create an empty ring with the given load slack and number of
+  // virtual nodes per node.
+  explicit bounded_load_ring(double epsilon = 0.25, std::size_t vnodes = 100,
+                             std::uint64_t seed = 0)
+    : epsilon_(epsilon), vnodes_(vnodes), proto_(seed), hash_(proto_)
+  {
+    if (!(epsilon > 0) || vnodes == 0)
+      throw std::invalid_argument("bounded_load_ring: bad parameters");
+  }
+
+  // Add a node with no load.
+  void insert(std::uint64_t node)
+  {
+    if (std::find(nodes_.begin(), nodes_.end(), node) != nodes_.end())
+      return;
+    nodes_.push_back(node);
+    loads_.push_back(0);
+    build();
+  }
+
+  // Remove a node. Its load is dropped; the keys assigned to it must be
+  // assigned again.
+  void erase(std::uint64_t node)
+  {
+    auto iter = std::find(nodes_.begin(), nodes_.end(), node);
+    if (iter == nodes_.end())
+      return;
+    std::size_t i = iter - nodes_.begin();
+    total_ -= loads_[i];
+    nodes_.erase(nodes_.begin() + i);
+    loads_.erase(loads_.begin() + i);
+    build();
+  }
+
+  // Returns the node that owns a key, ignoring loads.
+  template<Hashable_with<H> T>
+  std::uint64_t lookup(T const& t) const
+  {
+    return nodes_[owners_[first(hash_mix(hash_(t)))]];
+  }
+
+  // Assign a key to the first node at or after it that is below
+  // capacity, and return that node.
+  template<Hashable_with<H> T>
+  std::uint64_t assign(T const& t)
+  {
+    return nodes_[assign_digest(hash_mix(hash_(t)))];
+  }
+
+  // Assign a digest, returning the index of its node.
+  std::size_t assign_digest(std::uint64_t d)
+  {
+    if (nodes_.empty())
+      throw std::logic_error("bounded_load_ring: no nodes");
+    std::size_t cap = capacity(total_ + 1);
+    std::size_t v = first(d);
+    while (loads_[owners_[v]] >= cap)
+      v = v + 1 == owners_.size() ? 0 : v + 1;
+    ++loads_[owners_[v]];
+    ++total_;
+    return owners_[v];
+  }
+
+  // Release one key assigned to a node.
+  void release(std::uint64_t node)
+  {
+    auto iter = std::find(nodes_.begin(), nodes_.end(), node);
+    if (iter == nodes_.end() || loads_[iter - nodes_.begin()] == 0)
+      throw std::invalid_argument("bounded_load_ring: node has no load");
+    --loads_[iter - nodes_.begin()];
+    --total_;
+  }
+
+  // Returns the number of keys assigned to a node.
+  std::size_t load(std::uint64_t node) const
+  {
+    auto iter = std::find(nodes_.begin(), nodes_.end(), node);
+    return iter == nodes_.end() ? 0 : loads_[iter - nodes_.begin()];
+  }
+
+  // Returns the capacity of each node when m keys are assigned.
+  std::size_t capacity(std::size_t m) const
+  {
+    return static_cast<std::size_t>(std::ceil((1 + epsilon_) * m / nodes_.size()));
+  }
+
+  std::size_t size() const { return nodes_.size(); }
+  std::size_t total() const { return total_; }
+
+private:
+  // Rebuild the ring and its index.
+  void build()
+  {
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> ring;
+    ring.reserve(nodes_.size() * vnodes_);
+    for (std::uint32_t i = 0; i < nodes_.size(); ++i)
+      for (std::uint64_t r = 0; r < vnodes_; ++r) {
+        H h = proto_;
+        hash_append(h, nodes_[i], r);
+        ring.emplace_back(hash_mix(h.value()), i);
+      }
+    std::sort(ring.begin(), ring.end());
+    positions_.resize(ring.size());
+    owners_.resize(ring.size());
+    for (std::size_t v = 0; v < ring.size(); ++v) {
+      positions_[v] = ring[v].first;
+      owners_[v] = ring[v].second;
+    }
+
+    bits_ = 1;
+    while ((std::size_t(1) << bits_) < ring.size())
+      ++bits_;
+    index_.assign(std::size_t(1) << bits_, 0);
+    std::size_t v = 0;
+    for (std::size_t b = 0; b < index_.size(); ++b) {
+      std::uint64_t lo = std::uint64_t(b) << (64 - bits_);
+      while (v < positions_.size() && positions_[v] < lo)
+        ++v;
+      index_[b] = v;
+    }
+  }
+
+  // Returns the first virtual node at or after d.
+  std::size_t first(std::uint64_t d) const
+  {
+    if (positions_.empty())
+      throw std::logic_error("bounded_load_ring: no nodes");
+    std::size_t v = index_[d >> (64 - bits_)];
+    while (v < positions_.size() && positions_[v] < d)
+      ++v;
+    return v == positions_.size() ? 0 : v;
+  }
+
+  double epsilon_;
+  std::size_t vnodes_;
+  H proto_;
+  hash<H> hash_;
+  std::vector<std::uint64_t> nodes_;
+  std::vector<std::size_t> loads_;
+  std::size_t total_ = 0;
+  std::vector<std::uint64_t> positions_;
+  std::vector<std::uint32_t> owners_;
+  std::vector<std::size_t> index_;
+  unsigned bits_ = 1;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,180 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_COUNT_MIN_HPP
+#define ORIGIN_COUNT_MIN_HPP
+
+// A Count-Min sketch [1] for approximate frequency counts in fixed
+// memory. The sketch is a d x w array of counters. An object increments
+// one counter in each row, and its estimated count is the minimum of
+// those counters, which never underestimates the true count.
+//
+// The d column indexes are derived from a single 64-bit digest by
+// double hashing [2]: g_i = h1 + i * h2.
+//
+// With conservative update [3], an insertion raises each counter only
+// as far as needed for the new minimum, which reduces overestimation.
+//
+// Counters may be 8, 16, 32 or 64 bits wide. Narrow counters saturate
+// at their maximum value rather than wrapping.
+//
+// Sketches are not synchronized. For parallel counting, give each
+// thread its own sketch and merge them by addition when done.
+//
+// [1] G. Cormode and S. Muthukrishnan. An improved data stream summary:
+// the count-min sketch and its applications. J. Algorithms 55(1), 2005.
+//
+// [2] A. Kirsch and M. Mitzenmacher. Less hashing, same performance:
+// building a better Bloom filter. ESA 2006.
+//
+// [3] C. Estan and G. Varghese. New directions in traffic measurement
+// and accounting. SIGCOMM 2002.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+template<typename C = std::uint32_t, Hash_algorithm_64 H = fnv1a>
+class count_min_sketch
+{
+  static_assert(std::is_unsigned<C>::value, "counters must be unsigned");
+
+  static constexpr C max_count = std::numeric_limits<C>::max();
+
+public:
+  // Create a sketch with the given width (columns) and depth (rows).
+  count_min_sketch(std::size_t width, std::size_t depth,
+                   bool conservative = false, std::uint64_t seed = 0)
+    : width_(width), depth_(depth), conservative_(conservative),
+      seed_(seed), hash_(H(seed)), counts_(width * depth)
+  {
+    if (width == 0 || depth == 0 || width > 0xffffffffu)
+      throw std::invalid_argument("count_min_sketch: bad dimensions");
+  }
+
+  // Create a sketch whose estimates exceed the true count by at most
+  // epsilon times the total count, with probability 1 - delta.
+  static count_min_sketch with_error(double epsilon, double delta,
+                                     bool conservative = false,
+                                     std::uint64_t seed = 0)
+  {
+    std::size_t w = static_cast<std::size_t>(std::ceil(std::exp(1.0) / epsilon));
+    std::size_t d = static_cast<std::size_t>(std::ceil(std::log(1 / delta)));
+    return count_min_sketch(w, std::max<std::size_t>(d, 1), conservative, seed);
+  }
+
+  // Add c occurrences of an object.
+  template<Hashable_with<H> T>
+  void insert(T const& t, std::uint64_t c = 1)
+  {
+    insert_digest(hash_mix(hash_(t)), c);
+  }
+
+  // Add one occurrence of each object in [first, last). The digests of
+  // a batch of objects are computed, and their counters prefetched,
+  // before any counter is updated.
+  template<Forward_iterator I>
+    requires Hashable_type<H, Value_type<I>>()
+  void insert(I first, I last)
+  {
+    constexpr std::size_t batch = 16;
+    std::uint64_t ds[batch];
+    while (first != last) {
+      std::size_t n = 0;
+      for (; n < batch && first != last; ++n, ++first) {
+        ds[n] = hash_mix(hash_(*first));
+        for (std::size_t i = 0; i < depth_; ++i)
+          __builtin_prefetch(&counts_[cell(ds[n], i)], 1);
+      }
+      for (std::size_t k = 0; k < n; ++k)
+        insert_digest(ds[k], 1);
+    }
+  }
+
+  // Returns the estimated count of an object.
+  template<Hashable_with<H> T>
+  std::uint64_t estimate(T const& t) const
+  {
+    return estimate_digest(hash_mix(hash_(t)));
+  }
+
+  void insert_digest(std::uint64_t d, std::uint64_t c)
+  {
+    if (conservative_) {
+      C m = add(estimate_digest(d), c);
+      for (std::size_t i = 0; i < depth_; ++i) {
+        C& x = counts_[cell(d, i)];
+        if (x < m)
+          x = m;
+      }
+    } else {
+      for (std::size_t i = 0; i < depth_; ++i) {
+        C& x = counts_[cell(d, i)];
+        x = add(x, c);
+      }
+    }
+  }
+
+  std::uint64_t estimate_digest(std::uint64_t d) const
+  {
+    C m = max_count;
+    for (std::size_t i = 0; i < depth_; ++i)
+      m = std::min(m, counts_[cell(d, i)]);
+    return m;
+  }
+
+  // Add the counts of another sketch with the same dimensions and seed.
+  void merge(count_min_sketch const& x)
+  {
+    if (x.width_ != width_ || x.depth_ != depth_ || x.seed_ != seed_)
+      throw std::invalid_argument("count_min_sketch: incompatible sketches");
+    for (std::size_t i = 0; i < counts_.size(); ++i)
+      counts_[i] = add(counts_[i], x.counts_[i]);
+  }
+
+  void clear()
+  {
+    std::fill(counts_.begin(), counts_.end(), 0);
+  }
+
+  std::size_t width() const { return width_; }
+  std::size_t depth() const { return depth_; }
+  std::size_t size_in_bytes() const { return counts_.size() * sizeof(C); }
+
+private:
+  // Returns the index of the counter for digest d in row i.
+  std::size_t cell(std::uint64_t d, std::size_t i) const
+  {
+    std::uint32_t h1 = d >> 32;
+    std::uint32_t h2 = static_cast<std::uint32_t>(d) | 1;
+    std::uint32_t g = h1 + std::uint32_t(i) * h2;
+    return i * width_ + ((std::uint64_t(g) * width_) >> 32);
+  }
+
+  // Returns a + b, saturating at the maximum count. Here, a is at
+  // most the maximum count.
+  static C add(std::uint64_t a, std::uint64_t b)
+  {
+    return b > max_count - a ? max_count : C(a + b);
+  }
+
+  std::size_t width_;
+  std::size_t depth_;
+  bool conservative_;
+  std::uint64_t seed_;
+  hash<H> hash_;
+  std::vector<C> counts_;
+};
+
+
+} // namespace origin
+
+
+#endif
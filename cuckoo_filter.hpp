@@ -0,0 +1,361 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_CUCKOO_FILTER_HPP
+#define ORIGIN_CUCKOO_FILTER_HPP
+
+// A cuckoo filter [1] supporting insertion, deletion and growth. Each
+// key is reduced to a fingerprint of 8, 12 or 16 bits, which is stored
+// in one of two buckets of 4 slots. The alternate bucket is computed
+// from the fingerprint alone (partial-key cuckoo hashing).
+//
+// A bucket is packed into a single 64-bit word, so it is searched for a
+// fingerprint (or an empty slot) with a few word-wide operations that
+// test all 4 lanes at once.
+//
+// When an insertion fails, the evictions it made are undone and the key
+// is inserted into a new table of twice the size, which is chained to
+// the previous ones. Lookups and deletions search every table in the
+// chain. The number of tables grows logarithmically.
+//
+// A lookup misses one table with probability at least 1 - 8 / 2^Bits,
+// since it compares the fingerprint against at most 8 slots, so the
+// false positive rate of a chain of t tables is at most 8t / 2^Bits.
+//
+// Batched insertions and lookups compute the digests of a batch of keys
+// and prefetch both of their buckets before touching any of them.
+//
+// A key may be inserted more than once, and each copy is deleted
+// separately. Since a key has only two buckets of 4 slots, the filter
+// holds at most 8 copies of it; further insertions fail and return
+// false rather than adding tables. As with any cuckoo filter, only keys
+// that were inserted may be deleted.
+//
+// [1] B. Fan et al. Cuckoo filter: practically better than Bloom.
+// CoNEXT 2014.
+
+#include "hashing.hpp"
+
+#include <iterator>
+
+
+namespace origin
+{
+
+// -------------------------------------------------------------------------- //
+// Cuckoo tables
+
+// A table of buckets of 4 fingerprints of the given width, packed into
+// 64-bit words. A zero fingerprint denotes an empty slot.
+template<unsigned Bits>
+class cuckoo_table
+{
+  static_assert(Bits == 8 || Bits == 12 || Bits == 16,
+                "fingerprints must be 8, 12 or 16 bits");
+
+public:
+  static constexpr unsigned slots = 4;
+  static constexpr std::uint64_t lane_mask = (std::uint64_t(1) << Bits) - 1;
+
+  // A 1 in the low bit of every lane.
+  static constexpr std::uint64_t ones =
+    1 | (std::uint64_t(1) << Bits) | (std::uint64_t(1) << 2 * Bits) | (std::uint64_t(1) << 3 * Bits);
+
+  // A 1 in the high bit of every lane.
+  static constexpr std::uint64_t highs = ones << (Bits - 1);
+
+  // Create a table with 2^n buckets.
+  explicit cuckoo_table(unsigned n)
+    : buckets_(std::size_t(1) << n), mask_((std::size_t(1) << n) - 1)
+  { }
+
+  // Returns a mask with the high bit set in the lowest lane of b that
+  // equals f, or 0 if there is none.
+  static std::uint64_t match(std::uint64_t b, std::uint64_t f)
+  {
+    std::uint64_t x = b ^ (f * ones);
+    std::uint64_t m = (x - ones) & ~x & highs;
+    return m & -m;
+  }
+
+  // Returns the number of lanes of b that equal f.
+  static unsigned matches(std::uint64_t b, std::uint64_t f)
+  {
+    static constexpr std::uint64_t low = highs - ones;
+    std::uint64_t x = b ^ (f * ones);
+    return __builtin_popcountll(~(((x & low) + low) | x) & highs);
+  }
+
+  // Returns the lane of a mask returned by match().
+  static unsigned lane(std::uint64_t m)
+  {
+    return __builtin_ctzll(m) / Bits;
+  }
+
+  static std::uint64_t get(std::uint64_t b, unsigned i)
+  {
+    return (b >> (i * Bits)) & lane_mask;
+  }
+
+  static std::uint64_t set(std::uint64_t b, unsigned i, std::uint64_t f)
+  {
+    unsigned s = i * Bits;
+    return (b & ~(lane_mask << s)) | (f << s);
+  }
+
+  // Returns the alternate bucket of f in bucket i.
+  std::size_t alternate(std::size_t i, std::uint64_t f) const
+  {
+    return (i ^ hash_mix(f)) & mask_;
+  }
+
+  std::size_t index(std::uint64_t d) const
+  {
+    return (d >> 32) & mask_;
+  }
+
+  bool contains(std::size_t i, std::uint64_t f) const
+  {
+    std::size_t j = alternate(i, f);
+    return (match(buckets_[i], f) | match(buckets_[j], f)) != 0;
+  }
+
+  // Returns the number of copies of f in bucket i and its alternate.
+  unsigned count(std::size_t i, std::uint64_t f) const
+  {
+    std::size_t j = alternate(i, f);
+    return matches(buckets_[i], f) + (j != i ? matches(buckets_[j], f) : 0);
+  }
+
+  // Try to place f in bucket i or its alternate, evicting up to
+  // max_kicks fingerprints. On failure the table is unchanged.
+  bool insert(std::size_t i, std::uint64_t f, std::uint64_t& rng)
+  {
+    if (place(i, f) || place(alternate(i, f), f))
+      return true;
+
+    struct undo { std::size_t bucket; std::uint64_t word; };
+    undo log[max_kicks];
+    unsigned n = 0;
+    if (rng & 1)
+      i = alternate(i, f);
+    for (; n < max_kicks; ++n) {
+      rng = hash_mix(rng);
+      unsigned s = rng % slots;
+      std::uint64_t& b = buckets_[i];
+      log[n] = {i, b};
+      std::uint64_t victim = get(b, s);
+      b = set(b, s, f);
+      f = victim;
+      i = alternate(i, f);
+      if (place(i, f))
+        return true;
+    }
+    while (n-- > 0)
+      buckets_[log[n].bucket] = log[n].word;
+    return false;
+  }
+
+  // Remove one copy of f from bucket i or its alternate.
+  bool erase(std::size_t i, std::uint64_t f)
+  {
+    std::size_t j = alternate(i, f);
+    for (std::size_t k : {i, j}) {
+      if (std::uint64_t m = match(buckets_[k], f)) {
+        buckets_[k] = set(buckets_[k], lane(m), 0);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void prefetch(std::size_t i) const
+  {
+    __builtin_prefetch(&buckets_[i]);
+  }
+
+  std::size_t bucket_count() const { return buckets_.size(); }
+
+private:
+  static constexpr unsigned max_kicks = 500;
+
+  bool place(std::size_t i, std::uint64_t f)
+  {
+    if (std::uint64_t m = match(buckets_[i], 0)) {
+      buckets_[i] = set(buckets_[i], lane(m), f);
+      return true;
+    }
+    return false;
+  }
+
+  std::vector<std::uint64_t> buckets_;
+  std::size_t mask_;
+};
+
+
+// -------------------------------------------------------------------------- //
+// Cuckoo filter
+
+template<unsigned Bits = 12, Hash_algorithm_64 H = fnv1a>
+class cuckoo_filter
+{
+  using table = cuckoo_table<Bits>;
+
+public:
+  // Create a filter with an initial capacity of about n keys.
+  explicit cuckoo_filter(std::size_t n = 1024, std::uint64_t seed = 0)
+    : hash_(H(seed))
+  {
+    unsigned b = 0;
+    while ((std::size_t(table::slots) << b) * 95 / 100 < n)
+      ++b;
+    tables_.emplace_back(b);
+  }
+
+  // Insert an object. Returns false if the filter already holds the
+  // maximum number of copies of it.
+  template<Hashable_with<H> T>
+  bool insert(T const& t)
+  {
+    return insert_digest(digest(t));
+  }
+
+  template<Hashable_with<H> T>
+  bool contains(T const& t) const
+  {
+    return contains_digest(digest(t));
+  }
+
+  template<Hashable_with<H> T>
+  bool erase(T const& t)
+  {
+    return erase_digest(digest(t));
+  }
+
+  // Insert the keys in [first, last), skipping any copy beyond the
+  // maximum. The digests of a batch of keys
+  // are computed, and their buckets in the last table prefetched,
+  // before any of them is inserted.
+  template<Forward_iterator I>
+    requires Hashable_type<H, Value_type<I>>()
+  void insert(I first, I last)
+  {
+    std::uint64_t ds[batch];
+    while (first != last) {
+      std::size_t n = 0;
+      for (; n < batch && first != last; ++n, ++first) {
+        ds[n] = digest(*first);
+        prefetch(tables_.back(), ds[n]);
+      }
+      for (std::size_t k = 0; k < n; ++k)
+        insert_digest(ds[k]);
+    }
+  }
+
+  // Look up the keys in [first, last), writing the results to out. The
+  // digests of a batch of keys are computed, and their buckets
+  // prefetched, before any of them is probed.
+  template<Forward_iterator I, typename O>
+    requires Hashable_type<H, Value_type<I>>()
+  O contains(I first, I last, O out) const
+  {
+    std::uint64_t ds[batch];
+    while (first != last) {
+      std::size_t n = 0;
+      for (; n < batch && first != last; ++n, ++first) {
+        ds[n] = digest(*first);
+        for (table const& t : tables_)
+          prefetch(t, ds[n]);
+      }
+      for (std::size_t k = 0; k < n; ++k)
+        *out++ = contains_digest(ds[k]);
+    }
+    return out;
+  }
+
+  template<Hashable_with<H> T>
+  std::uint64_t digest(T const& t) const
+  {
+    return hash_mix(hash_(t));
+  }
+
+  bool insert_digest(std::uint64_t d)
+  {
+    std::uint64_t f = fingerprint(d);
+    unsigned copies = 0;
+    for (table const& t : tables_)
+      copies += t.count(t.index(d), f);
+    if (copies >= max_copies)
+      return false;
+    while (!tables_.back().insert(tables_.back().index(d), f, rng_)) {
+      unsigned b = 0;
+      while ((std::size_t(1) << b) < 2 * tables_.back().bucket_count())
+        ++b;
+      tables_.emplace_back(b);
+    }
+    ++size_;
+    return true;
+  }
+
+  bool contains_digest(std::uint64_t d) const
+  {
+    std::uint64_t f = fingerprint(d);
+    bool found = false;
+    for (table const& t : tables_)
+      found |= t.contains(t.index(d), f);
+    return found;
+  }
+
+  bool erase_digest(std::uint64_t d)
+  {
+    std::uint64_t f = fingerprint(d);
+    for (auto iter = tables_.rbegin(); iter != tables_.rend(); ++iter) {
+      if (iter->erase(iter->index(d), f)) {
+        --size_;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::size_t size() const { return size_; }
+  std::size_t table_count() const { return tables_.size(); }
+
+  std::size_t size_in_bytes() const
+  {
+    std::size_t n = 0;
+    for (table const& t : tables_)
+      n += t.bucket_count() * sizeof(std::uint64_t);
+    return n;
+  }
+
+private:
+  static constexpr std::size_t batch = 16;
+  static constexpr unsigned max_copies = 2 * table::slots;
+
+  // Prefetch both buckets of a digest in table t.
+  static void prefetch(table const& t, std::uint64_t d)
+  {
+    std::size_t i = t.index(d);
+    t.prefetch(i);
+    t.prefetch(t.alternate(i, fingerprint(d)));
+  }
+
+  // The low bits of the digest, avoiding the empty fingerprint.
+  static std::uint64_t fingerprint(std::uint64_t d)
+  {
+    std::uint64_t f = d & table::lane_mask;
+    return f ? f : 1;
+  }
+
+  std::vector<table> tables_;
+  hash<H> hash_;
+  std::uint64_t rng_ = 0x9e3779b97f4a7c15ull;
+  std::size_t size_ = 0;
+};
+
+
+} // namespace origin
+
+
+#endif
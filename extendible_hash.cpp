@@ -0,0 +1,269 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "extendible_hash.hpp"
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace origin
+{
+
+namespace
+{
+
+[[noreturn]] void
+throw_errno(char const* what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace
+
+
+// -------------------------------------------------------------------------- //
+// Page files
+
+page_file::page_file(page_file&& x) noexcept
+  : fd_(x.fd_), page_size_(x.page_size_)
+{
+  x.fd_ = -1;
+}
+
+
+page_file&
+page_file::operator=(page_file&& x) noexcept
+{
+  std::swap(fd_, x.fd_);
+  std::swap(page_size_, x.page_size_);
+  return *this;
+}
+
+
+page_file::~page_file()
+{
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+
+page_file::page_file(std::string const& path, std::size_t page_size, bool create)
+  : page_size_(page_size)
+{
+  int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0);
+  fd_ = ::open(path.c_str(), flags, 0644);
+  if (fd_ < 0)
+    throw_errno("open");
+}
+
+
+void
+page_file::read(std::uint64_t n, byte* buf) const
+{
+  std::size_t len = page_size_;
+  std::uint64_t off = n * page_size_;
+  while (len) {
+    ssize_t k = ::pread(fd_, buf, len, off);
+    if (k < 0) {
+      if (errno == EINTR)
+        continue;
+      throw_errno("pread");
+    }
+    if (k == 0) {
+      std::fill(buf, buf + len, 0);
+      return;
+    }
+    buf += k;
+    off += k;
+    len -= k;
+  }
+}
+
+
+void
+page_file::write(std::uint64_t n, byte const* buf)
+{
+  std::size_t len = page_size_;
+  std::uint64_t off = n * page_size_;
+  while (len) {
+    ssize_t k = ::pwrite(fd_, buf, len, off);
+    if (k < 0) {
+      if (errno == EINTR)
+        continue;
+      throw_errno("pwrite");
+    }
+    buf += k;
+    off += k;
+    len -= k;
+  }
+}
+
+
+void
+page_file::sync()
+{
+  if (::fdatasync(fd_) < 0)
+    throw_errno("fdatasync");
+}
+
+
+// -------------------------------------------------------------------------- //
+// Page cache
+
+page_cache::page_cache(page_file& f, std::size_t capacity)
+  : file_(&f), capacity_(capacity < 2 ? 2 : capacity)
+{ }
+
+
+byte*
+page_cache::fetch(std::uint64_t n)
+{
+  auto iter = map_.find(n);
+  if (iter != map_.end()) {
+    frames_.splice(frames_.begin(), frames_, iter->second);
+    return frames_.front().data.data();
+  }
+  return install(n, true);
+}
+
+
+byte*
+page_cache::allocate(std::uint64_t n)
+{
+  auto iter = map_.find(n);
+  if (iter != map_.end()) {
+    frames_.splice(frames_.begin(), frames_, iter->second);
+    frame& f = frames_.front();
+    std::fill(f.data.begin(), f.data.end(), 0);
+    return f.data.data();
+  }
+  return install(n, false);
+}
+
+
+void
+page_cache::dirty(std::uint64_t n)
+{
+  map_.at(n)->dirty = true;
+}
+
+
+void
+page_cache::hold(std::uint64_t n)
+{
+  frame& f = *map_.at(n);
+  held_ += !f.held;
+  f.held = true;
+}
+
+
+void
+page_cache::release()
+{
+  for (frame& f : frames_)
+    f.held = false;
+  held_ = 0;
+}
+
+
+void
+page_cache::flush()
+{
+  for (frame& f : frames_) {
+    if (f.dirty && !f.held) {
+      file_->write(f.page, f.data.data());
+      f.dirty = false;
+      ++writes_;
+    }
+  }
+}
+
+
+// Install page n at the front of the cache, evicting (and reusing the
+// buffer of) the least recently used page that is not held if the
+// cache is full.
+byte*
+page_cache::install(std::uint64_t n, bool read)
+{
+  auto victim = frames_.end();
+  if (frames_.size() >= capacity_) {
+    victim = std::prev(frames_.end());
+    while (victim->held && victim != frames_.begin())
+      --victim;
+    if (victim->held)
+      victim = frames_.end();
+  }
+  if (victim == frames_.end()) {
+    frames_.push_front({n, false, false, std::vector<byte>(file_->page_size())});
+  } else {
+    if (victim->dirty) {
+      file_->write(victim->page, victim->data.data());
+      ++writes_;
+    }
+    map_.erase(victim->page);
+    victim->page = n;
+    victim->dirty = false;
+    frames_.splice(frames_.begin(), frames_, victim);
+  }
+  frame& f = frames_.front();
+  map_[n] = frames_.begin();
+  if (read) {
+    file_->read(n, f.data.data());
+    ++reads_;
+  } else {
+    std::fill(f.data.begin(), f.data.end(), 0);
+  }
+  return f.data.data();
+}
+
+
+// -------------------------------------------------------------------------- //
+// Directory files
+
+std::vector<std::uint64_t>
+read_directory(std::string const& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw_errno("open");
+  std::vector<std::uint64_t> dir;
+  std::uint64_t buf[512];
+  while (true) {
+    ssize_t k = ::read(fd, buf, sizeof(buf));
+    if (k < 0) {
+      if (errno == EINTR)
+        continue;
+      int err = errno;
+      ::close(fd);
+      errno = err;
+      throw_errno("read");
+    }
+    if (k == 0)
+      break;
+    dir.insert(dir.end(), buf, buf + k / sizeof(std::uint64_t));
+  }
+  ::close(fd);
+  return dir;
+}
+
+
+// The directory is written to a temporary file and renamed into place,
+// so a crash leaves either the old or the new directory.
+void
+write_directory(std::string const& path, std::vector<std::uint64_t> const& dir)
+{
+  std::string tmp = path + ".tmp";
+  page_file f(tmp, dir.size() * sizeof(std::uint64_t), true);
+  f.write(0, reinterpret_cast<byte const*>(dir.data()));
+  f.sync();
+  if (::rename(tmp.c_str(), path.c_str()) < 0)
+    throw_errno("rename");
+}
+
+
+} // namespace origin
@@ -0,0 +1,421 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_EXTENDIBLE_HASH_HPP
+#define ORIGIN_EXTENDIBLE_HASH_HPP
+
+// An on-disk extendible hash index [1]. The index is a file of fixed
+// size bucket pages and an in-memory directory of 2^d page numbers,
+// indexed by the d leading bits of a key's digest. When a bucket
+// overflows, only that bucket is split: one new page is written and
+// the directory is updated (doubling it if needed). The cost of an
+// insertion is O(1) page I/O regardless of the size of the index.
+//
+// Pages are accessed through a write-back LRU page cache. The
+// directory and the file header are written by flush(), and by a
+// checkpoint when the cache fills with split pages.
+//
+// A page that is split loses the entries moved to its sibling, so it
+// must not reach the file before a directory that refers to the
+// sibling. Split pages are held in the cache until the next checkpoint,
+// which writes the other modified pages (including the siblings), the
+// header and then the directory, and only then releases them. A crash
+// therefore leaves the last directory written together with pages that
+// still hold every entry it can reach, and nothing flushed is lost.
+// Entries inserted since the last flush may or may not survive, and
+// size() may count them either way.
+//
+// The directory is limited to 2^24 slots (128 MiB). Inserting many keys
+// whose digests share their leading 24 bits throws.
+//
+// File layout: page 0 holds the header; every other page is a bucket.
+// The directory is stored in a companion file with the suffix ".dir".
+//
+// [1] R. Fagin et al. Extendible hashing - a fast access method for
+// dynamic files. ACM TODS 4(3), 1979.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+
+namespace origin
+{
+
+// -------------------------------------------------------------------------- //
+// Page files
+
+// A file of fixed size pages.
+class page_file
+{
+public:
+  page_file() = default;
+  page_file(page_file&&) noexcept;
+  page_file& operator=(page_file&&) noexcept;
+  ~page_file();
+
+  // Open the file at path, optionally creating (and truncating) it.
+  page_file(std::string const& path, std::size_t page_size, bool create);
+
+  // Read page n into buf. Pages past the end of the file read as zero.
+  void read(std::uint64_t n, byte* buf) const;
+
+  // Write page n from buf.
+  void write(std::uint64_t n, byte const* buf);
+
+  void sync();
+
+  std::size_t page_size() const { return page_size_; }
+
+private:
+  int fd_ = -1;
+  std::size_t page_size_ = 0;
+};
+
+
+// A write-back LRU cache of pages. A pointer returned by fetch() or
+// allocate() is valid until the next call to either function.
+class page_cache
+{
+public:
+  page_cache(page_file& f, std::size_t capacity);
+
+  // Returns the contents of page n, reading it if needed.
+  byte* fetch(std::uint64_t n);
+
+  // Returns the zero-filled contents of a new page n. The page is
+  // not read from the file.
+  byte* allocate(std::uint64_t n);
+
+  // Mark page n as modified. It will be written when evicted or
+  // flushed.
+  void dirty(std::uint64_t n);
+
+  // Hold page n in the cache: it is neither evicted nor written until
+  // release() is called. The cache grows past its capacity if every
+  // page is held.
+  void hold(std::uint64_t n);
+
+  // Release all held pages.
+  void release();
+
+  // Write all modified pages that are not held.
+  void flush();
+
+  std::size_t held() const { return held_; }
+  std::size_t capacity() const { return capacity_; }
+
+  std::uint64_t reads() const { return reads_; }
+  std::uint64_t writes() const { return writes_; }
+
+private:
+  struct frame
+  {
+    std::uint64_t page;
+    bool dirty;
+    bool held;
+    std::vector<byte> data;
+  };
+
+  using frame_list = std::list<frame>;
+
+  byte* install(std::uint64_t n, bool read);
+
+  page_file* file_;
+  std::size_t capacity_;
+  frame_list frames_; // Most recently used first.
+  std::unordered_map<std::uint64_t, frame_list::iterator> map_;
+  std::size_t held_ = 0;
+  std::uint64_t reads_ = 0;
+  std::uint64_t writes_ = 0;
+};
+
+
+// Read and write the directory file of an extendible hash index.
+std::vector<std::uint64_t> read_directory(std::string const& path);
+void write_directory(std::string const& path, std::vector<std::uint64_t> const& dir);
+
+
+// -------------------------------------------------------------------------- //
+// Extendible hash index
+
+// An extendible hash index mapping keys of type K to values of type V.
+// Both are stored directly in pages, so they must be trivially copyable.
+template<Trivially_comparable K, typename V, Hash_algorithm_64 H = fnv1a>
+class extendible_hash
+{
+  static_assert(std::is_trivially_copyable<V>::value,
+                "index values must be trivially copyable");
+
+  static constexpr std::uint64_t magic = 0x6f726967696e4548ull; // "originEH"
+  static constexpr unsigned max_depth = 24;
+
+  struct header
+  {
+    std::uint64_t magic;
+    std::uint64_t seed;
+    std::uint64_t page_size;
+    std::uint64_t key_size;
+    std::uint64_t value_size;
+    std::uint64_t pages;
+    std::uint64_t size;
+    std::uint64_t depth;
+  };
+
+  struct entry
+  {
+    K key;
+    V value;
+  };
+
+  // The header of a bucket page. The entries follow.
+  struct bucket
+  {
+    std::uint32_t depth;
+    std::uint32_t count;
+  };
+
+public:
+  // Create a new index at path.
+  static extendible_hash create(std::string const& path, std::uint64_t seed,
+                                std::size_t cache_pages = 1024,
+                                std::size_t page_size = 4096)
+  {
+    if (page_size < sizeof(header) || bucket_capacity(page_size) < 2)
+      throw std::invalid_argument("extendible_hash: page size too small");
+    extendible_hash t(path, page_size, true, cache_pages);
+    t.hdr_ = {magic, seed, page_size, sizeof(K), sizeof(V), 2, 0, 0};
+    t.hash_ = hash<H>(H(seed));
+    t.dir_.assign(1, 1);
+    t.cache_.allocate(1);
+    t.cache_.dirty(1);
+    t.flush();
+    return t;
+  }
+
+  // Open an existing index at path.
+  static extendible_hash open(std::string const& path, std::size_t cache_pages = 1024)
+  {
+    header h;
+    {
+      page_file f(path, sizeof(header), false);
+      f.read(0, reinterpret_cast<byte*>(&h));
+    }
+    if (h.magic != magic)
+      throw std::runtime_error("extendible_hash: not an index file");
+    if (h.key_size != sizeof(K) || h.value_size != sizeof(V))
+      throw std::runtime_error("extendible_hash: key or value type mismatch");
+    extendible_hash t(path, h.page_size, false, cache_pages);
+    t.hdr_ = h;
+    t.hash_ = hash<H>(H(h.seed));
+    t.dir_ = read_directory(path + ".dir");
+    // The header is written before the directory, so after a crash its
+    // depth may be newer. The directory's size is authoritative.
+    std::size_t n = t.dir_.size();
+    if (n == 0 || (n & (n - 1)) != 0 || n > (std::size_t(1) << max_depth))
+      throw std::runtime_error("extendible_hash: corrupt directory");
+    t.hdr_.depth = __builtin_ctzll(n);
+    for (std::uint64_t page : t.dir_)
+      if (page == 0 || page >= t.hdr_.pages)
+        throw std::runtime_error("extendible_hash: corrupt directory");
+    return t;
+  }
+
+  extendible_hash(extendible_hash&&) = default;
+
+  // Flush the index, ignoring errors. Call flush() first to have them
+  // reported.
+  ~extendible_hash()
+  {
+    if (file_)
+      try {
+        flush();
+      } catch (...) { }
+  }
+
+  // Insert or assign the value of k. Returns true if k is new.
+  bool insert(K const& k, V const& v)
+  {
+    std::uint64_t d = digest(k);
+    while (true) {
+      std::uint64_t page = dir_[slot(d)];
+      byte* p = cache_.fetch(page);
+      bucket* b = reinterpret_cast<bucket*>(p);
+      entry* e = entries(p);
+      for (std::uint32_t i = 0; i < b->count; ++i) {
+        if (e[i].key == k) {
+          e[i].value = v;
+          cache_.dirty(page);
+          return false;
+        }
+      }
+      if (b->count < bucket_capacity(hdr_.page_size)) {
+        e[b->count++] = {k, v};
+        cache_.dirty(page);
+        ++hdr_.size;
+        return true;
+      }
+      split(page);
+    }
+  }
+
+  // Copy the value of k into v. Returns false if k is not present.
+  bool find(K const& k, V& v)
+  {
+    byte* p = cache_.fetch(dir_[slot(digest(k))]);
+    bucket const* b = reinterpret_cast<bucket const*>(p);
+    entry const* e = entries(p);
+    for (std::uint32_t i = 0; i < b->count; ++i) {
+      if (e[i].key == k) {
+        v = e[i].value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Remove k. Returns false if k is not present. Buckets are not
+  // merged.
+  bool erase(K const& k)
+  {
+    std::uint64_t page = dir_[slot(digest(k))];
+    byte* p = cache_.fetch(page);
+    bucket* b = reinterpret_cast<bucket*>(p);
+    entry* e = entries(p);
+    for (std::uint32_t i = 0; i < b->count; ++i) {
+      if (e[i].key == k) {
+        e[i] = e[--b->count];
+        cache_.dirty(page);
+        --hdr_.size;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Write all modified pages, the header, and the directory.
+  void flush()
+  {
+    checkpoint();
+    cache_.flush();
+    file_->sync();
+  }
+
+  std::size_t size() const { return hdr_.size; }
+  std::size_t depth() const { return hdr_.depth; }
+  std::size_t pages() const { return hdr_.pages; }
+  page_cache const& cache() const { return cache_; }
+
+private:
+  extendible_hash(std::string const& path, std::size_t page_size, bool create,
+                  std::size_t cache_pages)
+    : path_(path),
+      file_(new page_file(path, page_size, create)),
+      cache_(*file_, cache_pages)
+  { }
+
+  static std::size_t bucket_capacity(std::size_t page_size)
+  {
+    return (page_size - sizeof(bucket)) / sizeof(entry);
+  }
+
+  static entry* entries(byte* p)
+  {
+    return reinterpret_cast<entry*>(p + sizeof(bucket));
+  }
+
+  std::uint64_t digest(K const& k) const
+  {
+    return hash_mix(hash_(k));
+  }
+
+  // Returns the directory slot of a digest: its leading depth bits.
+  std::size_t slot(std::uint64_t d) const
+  {
+    return hdr_.depth ? d >> (64 - hdr_.depth) : 0;
+  }
+
+  // Write the modified pages that are not held, then the header and the
+  // directory, and release the held pages. The sibling of a split page
+  // is not held, so it reaches the file before the directory that
+  // refers to it.
+  void checkpoint()
+  {
+    cache_.flush();
+    std::vector<byte> buf(hdr_.page_size);
+    std::memcpy(buf.data(), &hdr_, sizeof(header));
+    file_->write(0, buf.data());
+    file_->sync();
+    write_directory(path_ + ".dir", dir_);
+    cache_.release();
+  }
+
+  // Split the bucket in page, doubling the directory if the bucket's
+  // local depth equals the global depth. The page is held until the
+  // next checkpoint.
+  void split(std::uint64_t page)
+  {
+    if (cache_.held() >= cache_.capacity() / 2)
+      checkpoint();
+
+    byte* p = cache_.fetch(page);
+    bucket* b = reinterpret_cast<bucket*>(p);
+    std::uint32_t depth = b->depth;
+    if (depth == max_depth)
+      throw std::runtime_error("extendible_hash: too many colliding keys");
+
+    if (depth == hdr_.depth) {
+      std::vector<std::uint64_t> dir(dir_.size() * 2);
+      for (std::size_t i = 0; i < dir_.size(); ++i)
+        dir[2 * i] = dir[2 * i + 1] = dir_[i];
+      dir_.swap(dir);
+      ++hdr_.depth;
+    }
+
+    // Partition the entries on the next leading bit.
+    std::uint64_t bit = std::uint64_t(1) << (63 - depth);
+    std::vector<entry> low, high;
+    entry const* e = entries(p);
+    for (std::uint32_t i = 0; i < b->count; ++i)
+      (digest(e[i].key) & bit ? high : low).push_back(e[i]);
+
+    b->depth = depth + 1;
+    b->count = low.size();
+    std::copy(low.begin(), low.end(), entries(p));
+    cache_.dirty(page);
+    cache_.hold(page);
+
+    std::uint64_t sibling = hdr_.pages++;
+    byte* q = cache_.allocate(sibling);
+    bucket* c = reinterpret_cast<bucket*>(q);
+    c->depth = depth + 1;
+    c->count = high.size();
+    std::copy(high.begin(), high.end(), entries(q));
+    cache_.dirty(sibling);
+
+    // The slots referring to the old page form a contiguous range of
+    // 2^(global - local) entries; the upper half moves to the sibling.
+    std::size_t span = std::size_t(1) << (hdr_.depth - depth);
+    std::size_t first = slot(digest(low.empty() ? high[0].key : low[0].key)) & ~(span - 1);
+    for (std::size_t i = first + span / 2; i < first + span; ++i)
+      dir_[i] = sibling;
+  }
+
+  std::string path_;
+  std::unique_ptr<page_file> file_;
+  page_cache cache_;
+  header hdr_;
+  hash<H> hash_;
+  std::vector<std::uint64_t> dir_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,250 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_EXTERNAL_DEDUP_HPP
+#define ORIGIN_EXTERNAL_DEDUP_HPP
+
+// Removal of duplicate records from a stream larger than memory, by
+// hash partitioning [1].
+//
+// Records are inserted into an in-memory hash set until the estimated
+// size of the set reaches its share of the memory budget. The set is
+// then spilled: each record is appended to one of 16 run files in a
+// directory, chosen by the high bits of its digest, and the set is
+// cleared. Since equal records always go to the same run, the runs can
+// be deduplicated independently. When the input ends, each run is read
+// back and deduplicated in the same way, with a differently seeded
+// hash, so a run that still does not fit in memory is split again.
+//
+// Runs are written and read sequentially through buffers of fixed
+// size, and the write buffers are counted in the budget, as are the
+// set's records and buckets. A spill frees the set, and a run is
+// finished before the next is read, so the memory in use is at most
+// the budget plus one read buffer per level of the recursion.
+//
+// A set holding a single record is never spilled, since splitting it
+// cannot help; a record larger than the budget is kept in memory. A
+// partition that is still too large after the deepest level allowed is
+// deduplicated in memory rather than partitioned again.
+//
+// Run format (native byte order), repeated:
+//
+//    u32 length
+//    record
+//
+// [1] G. Graefe. Query evaluation techniques for large databases. ACM
+// Computing Surveys 25(2), 1993.
+
+#include "log_store.hpp"
+
+#include <cstring>
+#include <memory>
+#include <unordered_set>
+
+
+namespace origin
+{
+
+template<Hash_algorithm_64 H = fnv1a>
+class external_dedup
+{
+  static constexpr unsigned fanout_bits = 4;
+  static constexpr std::size_t fanout = std::size_t(1) << fanout_bits;
+  static constexpr unsigned max_depth = 8;
+
+  // The estimated memory used by a record in the set, besides its bytes
+  // and its bucket.
+  static constexpr std::size_t entry_overhead = sizeof(std::string) + 32;
+
+  // State shared by every level of the recursion.
+  struct shared
+  {
+    std::uint32_t next_id = 0;
+    std::size_t spills = 0;
+  };
+
+  // A run file with a write buffer.
+  struct run
+  {
+    std::string path;
+    log_file file;
+    std::string buf;
+  };
+
+public:
+  // Create a stage that keeps at most about budget bytes in memory and
+  // writes its runs to dir, which must exist.
+  external_dedup(std::string const& dir, std::size_t budget, std::uint64_t seed = 0)
+    : external_dedup(dir, budget, seed, 0, std::make_shared<shared>())
+  { }
+
+  ~external_dedup()
+  {
+    for (run& r : runs_)
+      if (!r.path.empty())
+        try {
+          remove_log_file(r.path);
+        } catch (...) { }
+  }
+
+  // Insert a record.
+  void insert(std::string const& r)
+  {
+    if (r.size() > 0xffffffffu)
+      throw std::length_error("external_dedup: record too large");
+    if (!set_.insert(r).second)
+      return;
+    bytes_ += r.size() + entry_overhead;
+    std::size_t used = bytes_ + set_.bucket_count() * sizeof(void*);
+    if (used > limit_ && set_.size() > 1 && depth_ + 1 < max_depth)
+      spill();
+  }
+
+  // Call emit(r) once for each distinct record inserted, in an
+  // unspecified order, and remove the runs. No records may be inserted
+  // afterwards.
+  template<typename F>
+  void finish(F emit)
+  {
+    if (runs_.empty()) {
+      for (std::string const& r : set_)
+        emit(r);
+      release();
+      return;
+    }
+    spill();
+    for (run& r : runs_)
+      if (r.file) {
+        flush(r);
+        std::string().swap(r.buf);
+      }
+
+    // Each run is read into a child stage, which is finished (and frees
+    // its memory) before the next run is read.
+    for (run& r : runs_) {
+      if (!r.file)
+        continue;
+      external_dedup part(dir_, budget_, hash_mix(seed_ + 1), depth_ + 1, shared_);
+      std::string rec;
+      for (std::uint64_t off = 0; read(r, off, rec); )
+        part.insert(rec);
+      std::string().swap(r.buf);
+      reading_ = nullptr;
+      r.file = log_file();
+      remove_log_file(r.path);
+      r.path.clear();
+      part.finish(emit);
+    }
+    runs_.clear();
+  }
+
+  // Returns the number of times a set has been spilled to runs, at any
+  // level.
+  std::size_t spills() const { return shared_->spills; }
+
+private:
+  external_dedup(std::string const& dir, std::size_t budget, std::uint64_t seed,
+                 unsigned depth, std::shared_ptr<shared> s)
+    : dir_(dir), budget_(budget), seed_(seed), depth_(depth), shared_(std::move(s)),
+      hash_(H(seed)), set_(0, hash_)
+  {
+    // Half the budget goes to the set, and half to the run buffers.
+    buffer_ = std::max<std::size_t>(budget / (2 * fanout), 64);
+    limit_ = budget / 2;
+    if (budget < 1024)
+      throw std::invalid_argument("external_dedup: budget too small");
+  }
+
+  // Append every record in the set to its run, and clear the set.
+  void spill()
+  {
+    if (runs_.empty())
+      runs_.resize(fanout);
+    for (std::string const& r : set_) {
+      run& x = runs_[hash_mix(hash_(r)) >> (64 - fanout_bits)];
+      if (!x.file) {
+        x.path = log_segment_path(dir_, shared_->next_id++, "run");
+        x.file = log_file(x.path, true);
+        x.buf.reserve(buffer_);
+      }
+      std::uint32_t n = r.size();
+      if (x.buf.size() + sizeof(n) + n > buffer_)
+        flush(x);
+      if (sizeof(n) + n > buffer_) {
+        x.file.append(&n, sizeof(n));
+        x.file.append(r.data(), n);
+      } else {
+        x.buf.append(reinterpret_cast<char const*>(&n), sizeof(n));
+        x.buf.append(r);
+      }
+    }
+    release();
+    ++shared_->spills;
+  }
+
+  // Clear the set and free its buckets.
+  void release()
+  {
+    decltype(set_)(0, hash_).swap(set_);
+    bytes_ = 0;
+  }
+
+  static void flush(run& x)
+  {
+    x.file.append(x.buf.data(), x.buf.size());
+    x.buf.clear();
+  }
+
+  // Read the record at off in a run into rec, and advance off. Returns
+  // false at the end of the run. Reads are buffered.
+  bool read(run& x, std::uint64_t& off, std::string& rec)
+  {
+    std::uint32_t n;
+    if (!fetch(x, off, &n, sizeof(n)))
+      return false;
+    rec.resize(n);
+    if (!fetch(x, off + sizeof(n), &rec[0], n))
+      throw std::runtime_error("external_dedup: truncated run");
+    off += sizeof(n) + n;
+    return true;
+  }
+
+  // Copy n bytes at off in a run to p, reading a buffer at a time.
+  // Returns false if there are fewer than n bytes.
+  bool fetch(run& x, std::uint64_t off, void* p, std::size_t n)
+  {
+    if (off + n > x.file.size())
+      return false;
+    if (n > buffer_)
+      return x.file.read_at(off, p, n);
+    if (off < read_off_ || off + n > read_off_ + x.buf.size() || &x != reading_) {
+      x.buf.resize(std::min<std::uint64_t>(buffer_, x.file.size() - off));
+      if (!x.file.read_at(off, &x.buf[0], x.buf.size()))
+        return false;
+      read_off_ = off;
+      reading_ = &x;
+    }
+    std::memcpy(p, &x.buf[off - read_off_], n);
+    return true;
+  }
+
+  std::string dir_;
+  std::size_t budget_;
+  std::uint64_t seed_;
+  unsigned depth_;
+  std::shared_ptr<shared> shared_;
+  hash<H> hash_;
+  std::unordered_set<std::string, hash<H>> set_;
+  std::size_t bytes_ = 0;
+  std::size_t limit_;
+  std::size_t buffer_;
+  std::vector<run> runs_;
+  run const* reading_ = nullptr;
+  std::uint64_t read_off_ = 0;
+};
+
+
+} // namespace origin
+
+
+#endif
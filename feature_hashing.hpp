@@ -0,0 +1,188 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_FEATURE_HASHING_HPP
+#define ORIGIN_FEATURE_HASHING_HPP
+
+// Feature hashing (the "hashing trick") [1], which maps named features
+// directly to the columns of a 2^b-dimensional sparse vector without a
+// dictionary.
+//
+// A feature is a (namespace, name, value) triple. The namespace is
+// hashed once to a 64-bit digest, and the digest and name are hashed
+// together with the variadic hash_append, as in Vowpal Wabbit. The low
+// b bits of the mixed digest select the column and the high bit selects
+// the sign of the value, which makes the inner products of hashed
+// vectors unbiased. Hashing the namespace to a fixed-size digest first
+// also keeps ("ab", "c") and ("a", "bc") apart.
+//
+// A batch of rows is written directly to a matrix in compressed sparse
+// row (CSR) form. Features of a row that hash to the same column are
+// summed, and columns whose sum is zero are dropped.
+//
+// [1] K. Weinberger et al. Feature hashing for large scale multitask
+// learning. ICML 2009.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+
+namespace origin
+{
+
+// A named feature with a value.
+template<typename N, typename F>
+struct feature
+{
+  N space;
+  F name;
+  float value = 1;
+};
+
+
+// A sparse matrix in compressed sparse row form. The entries of row i
+// are at positions [offsets[i], offsets[i + 1]) of columns and values,
+// in increasing order of column.
+struct csr_matrix
+{
+  std::size_t cols = 0;
+  std::vector<std::size_t> offsets {0};
+  std::vector<std::uint32_t> columns;
+  std::vector<float> values;
+
+  std::size_t rows() const { return offsets.size() - 1; }
+  std::size_t nonzeros() const { return columns.size(); }
+};
+
+
+template<Hash_algorithm_64 H = fnv1a>
+class feature_hasher
+{
+public:
+  // A column and the sign applied to values in that column.
+  struct slot
+  {
+    std::uint32_t column;
+    float sign;
+  };
+
+  // Create a hasher for 2^bits columns, 1 <= bits <= 32.
+  explicit feature_hasher(unsigned bits, std::uint64_t seed = 0)
+    : bits_(bits), proto_(seed)
+  {
+    if (bits < 1 || bits > 32)
+      throw std::invalid_argument("feature_hasher: bad width");
+  }
+
+  // Returns the digest of a namespace.
+  template<Hashable_with<H> N>
+  std::uint64_t space(N const& ns) const
+  {
+    H h = proto_;
+    hash_append(h, ns);
+    return h.value();
+  }
+
+  // Returns the slot of a feature in the namespace with digest ns.
+  template<Hashable_with<H> F>
+  slot operator()(std::uint64_t ns, F const& name) const
+  {
+    H h = proto_;
+    hash_append(h, ns, name);
+    std::uint64_t d = hash_mix(h.value());
+    std::uint64_t mask = (std::uint64_t(1) << bits_) - 1;
+    return {static_cast<std::uint32_t>(d & mask), (d >> 63) ? -1.0f : 1.0f};
+  }
+
+  // Append the hashed rows in [first, last) to the matrix m. Each row
+  // is a range of features. Rows are hashed in parallel with the given
+  // number of threads.
+  template<Forward_iterator I>
+  void transform(I first, I last, csr_matrix& m, unsigned threads = 1) const
+  {
+    std::size_t n = std::distance(first, last);
+    threads = std::max(1u, threads);
+    std::size_t chunk = (n + threads - 1) / threads;
+    m.cols = std::size_t(1) << bits_;
+    if (threads == 1 || n < 2 * threads) {
+      append(first, last, m);
+      return;
+    }
+
+    // Each thread builds a part, and the parts are concatenated.
+    std::vector<csr_matrix> parts((n + chunk - 1) / chunk);
+    std::vector<std::thread> ts;
+    for (std::size_t p = 0; p < parts.size(); ++p) {
+      I lo = std::next(first, p * chunk);
+      I hi = std::next(lo, std::min(chunk, n - p * chunk));
+      ts.emplace_back([this, lo, hi, &parts, p] { append(lo, hi, parts[p]); });
+    }
+    for (std::thread& t : ts)
+      t.join();
+    for (csr_matrix const& part : parts) {
+      std::size_t base = m.columns.size();
+      for (std::size_t i = 1; i < part.offsets.size(); ++i)
+        m.offsets.push_back(base + part.offsets[i]);
+      m.columns.insert(m.columns.end(), part.columns.begin(), part.columns.end());
+      m.values.insert(m.values.end(), part.values.begin(), part.values.end());
+    }
+  }
+
+  // Returns the hashed rows in [first, last).
+  template<Forward_iterator I>
+  csr_matrix transform(I first, I last, unsigned threads = 1) const
+  {
+    csr_matrix m;
+    transform(first, last, m, threads);
+    return m;
+  }
+
+  unsigned bits() const { return bits_; }
+
+private:
+  template<typename I>
+  void append(I first, I last, csr_matrix& m) const
+  {
+    std::vector<std::pair<std::uint32_t, float>> row;
+    for (; first != last; ++first) {
+      row.clear();
+      std::uint64_t ns = 0;
+      decltype(&std::cbegin(*first)->space) prev = nullptr;
+      for (auto const& f : *first) {
+        // Consecutive features usually share a namespace.
+        if (!prev || !(f.space == *prev)) {
+          ns = space(f.space);
+          prev = &f.space;
+        }
+        slot s = (*this)(ns, f.name);
+        row.emplace_back(s.column, s.sign * f.value);
+      }
+      std::sort(row.begin(), row.end(),
+                [](auto const& a, auto const& b) { return a.first < b.first; });
+      for (std::size_t i = 0; i < row.size(); ) {
+        std::uint32_t c = row[i].first;
+        float v = 0;
+        for (; i < row.size() && row[i].first == c; ++i)
+          v += row[i].second;
+        if (v != 0) {
+          m.columns.push_back(c);
+          m.values.push_back(v);
+        }
+      }
+      m.offsets.push_back(m.columns.size());
+    }
+  }
+
+  unsigned bits_;
+  H proto_;
+};
+
+
+} // namespace origin
+
+
+#endif
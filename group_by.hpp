@@ -0,0 +1,238 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_GROUP_BY_HPP
+#define ORIGIN_GROUP_BY_HPP
+
+// Parallel hash aggregation [1, 2], computing the sum, count, minimum
+// and maximum of a value for each group of rows with equal keys.
+//
+// Keys are tuples, and the fields of a key are hashed together with the
+// variadic hash_append. Each thread aggregates a part of the input into
+// a small local table that fits in cache. When the local table is full,
+// its partial groups are spilled to one of 2^b partitions, by the high
+// bits of their digests, and the table is cleared. With few distinct
+// keys, the local table absorbs every row and is spilled once at the
+// end, so threads share nothing until the merge. With many, each
+// spill still carries partially aggregated groups, and the work of a
+// thread is sequential writes to its partitions.
+//
+// The partitions are then merged in parallel, with threads taking
+// partitions in turn. Since a key always falls in the same partition,
+// each partition's groups are final once its spills are merged, and the
+// result is the concatenation of the partitions.
+//
+// [1] V. Leis et al. Morsel-driven parallelism: a NUMA-aware query
+// evaluation framework for the many-core age. SIGMOD 2014.
+//
+// [2] I. Müller et al. Cache-efficient aggregation: hashing is sorting.
+// SIGMOD 2015.
+
+#include "radix_partition.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+
+namespace origin
+{
+
+// The aggregates of a group.
+template<typename Key, typename V>
+struct group
+{
+  Key key;
+  V sum;
+  std::uint64_t count;
+  V min;
+  V max;
+};
+
+
+// Aggregates values grouped by keys of type Key, a tuple.
+template<typename Key, typename V = double, Hash_algorithm_64 H = fnv1a>
+class group_by
+{
+  // A partial group and the digest of its key.
+  struct entry
+  {
+    std::uint64_t digest;
+    group<Key, V> g;
+  };
+
+  // An open-addressed table of up to limit entries. The slots hold the
+  // index of an entry plus one, or 0 if empty.
+  struct table
+  {
+    explicit table(std::size_t limit)
+      : limit(limit)
+    {
+      std::size_t size = 2;
+      while (size < 2 * limit)
+        size *= 2;
+      slots.assign(size, 0);
+      entries.reserve(limit);
+    }
+
+    // Returns the entry for a key, or a new entry with the key if there
+    // was none and the table is not full, or null.
+    entry* find(std::uint64_t d, Key const& k, bool& added)
+    {
+      std::size_t mask = slots.size() - 1;
+      for (std::size_t i = d & mask; ; i = (i + 1) & mask) {
+        std::uint32_t s = slots[i];
+        if (s == 0) {
+          if (entries.size() == limit)
+            return nullptr;
+          entries.push_back({d, {k, V(), 0, V(), V()}});
+          slots[i] = entries.size();
+          added = true;
+          return &entries.back();
+        }
+        entry& e = entries[s - 1];
+        if (e.digest == d && e.g.key == k) {
+          added = false;
+          return &e;
+        }
+      }
+    }
+
+    void clear()
+    {
+      std::fill(slots.begin(), slots.end(), 0);
+      entries.clear();
+    }
+
+    std::size_t limit;
+    std::vector<std::uint32_t> slots;
+    std::vector<entry> entries;
+  };
+
+public:
+  // Create an aggregator whose local tables hold up to the given number
+  // of groups, spilling to 2^bits partitions.
+  explicit group_by(std::size_t local_groups = 1024, unsigned bits = 6, std::uint64_t seed = 0)
+    : local_(local_groups), bits_(bits), proto_(seed)
+  {
+    if (local_groups == 0 || local_groups > 0x7fffffffu || bits > 16)
+      throw std::invalid_argument("group_by: bad parameters");
+  }
+
+  // Returns the groups of rows[0, n), grouped by key(rows[i]) and
+  // aggregating value(rows[i]), using the given number of threads. The
+  // order of the groups is unspecified.
+  template<typename R, typename K, typename F>
+  std::vector<group<Key, V>> operator()(R const* rows, std::size_t n, K key, F value,
+                                        unsigned threads = 1) const
+  {
+    threads = std::max(1u, threads);
+    std::size_t fanout = std::size_t(1) << bits_;
+    unsigned shift = 64 - bits_;
+
+    // Pre-aggregate each chunk, spilling to the thread's partitions.
+    std::size_t chunk = (n + threads - 1) / threads;
+    std::size_t parts = n ? (n + chunk - 1) / chunk : 0;
+    std::vector<std::vector<std::vector<entry>>> spills(parts, std::vector<std::vector<entry>>(fanout));
+    radix_detail::run(parts, [&](std::size_t t) {
+      std::vector<std::vector<entry>>& out = spills[t];
+      auto spill = [&](table& local) {
+        for (entry const& e : local.entries)
+          out[bits_ ? e.digest >> shift : 0].push_back(e);
+        local.clear();
+      };
+      table local(local_);
+      std::size_t lo = t * chunk, hi = std::min(n, lo + chunk);
+      for (std::size_t i = lo; i < hi; ++i) {
+        Key k = key(rows[i]);
+        std::uint64_t d = digest(k);
+        bool added;
+        entry* e = local.find(d, k, added);
+        if (!e) {
+          spill(local);
+          e = local.find(d, k, added);
+        }
+        V v = value(rows[i]);
+        group<Key, V>& g = e->g;
+        if (added) {
+          g.sum = g.min = g.max = v;
+          g.count = 1;
+        } else {
+          g.sum += v;
+          ++g.count;
+          g.min = std::min(g.min, v);
+          g.max = std::max(g.max, v);
+        }
+      }
+      spill(local);
+    });
+
+    // Merge the spills of each partition.
+    std::vector<std::vector<group<Key, V>>> results(fanout);
+    std::atomic<std::size_t> next(0);
+    radix_detail::run(std::min<std::size_t>(threads, fanout), [&](std::size_t) {
+      for (std::size_t p; (p = next++) < fanout; ) {
+        std::size_t m = 0;
+        for (std::vector<std::vector<entry>> const& s : spills)
+          m += s[p].size();
+        if (m == 0)
+          continue;
+        table merged(m);
+        for (std::vector<std::vector<entry>>& s : spills) {
+          for (entry const& x : s[p]) {
+            bool added;
+            entry* e = merged.find(x.digest, x.g.key, added);
+            if (added)
+              e->g = x.g;
+            else
+              accumulate(e->g, x.g);
+          }
+          std::vector<entry>().swap(s[p]);
+        }
+        for (entry const& e : merged.entries)
+          results[p].push_back(e.g);
+      }
+    });
+
+    std::vector<group<Key, V>> r;
+    for (std::vector<group<Key, V>>& x : results)
+      r.insert(r.end(), x.begin(), x.end());
+    return r;
+  }
+
+  // Returns the mixed digest of a key.
+  std::uint64_t digest(Key const& k) const
+  {
+    H h = proto_;
+    append(h, k, std::make_index_sequence<std::tuple_size<Key>::value>());
+    return hash_mix(h.value());
+  }
+
+private:
+  template<std::size_t... I>
+  static void append(H& h, Key const& k, std::index_sequence<I...>)
+  {
+    hash_append(h, std::get<I>(k)...);
+  }
+
+  // Combine the partial group x into g.
+  static void accumulate(group<Key, V>& g, group<Key, V> const& x)
+  {
+    g.sum += x.sum;
+    g.count += x.count;
+    g.min = std::min(g.min, x.min);
+    g.max = std::max(g.max, x.max);
+  }
+
+  std::size_t local_;
+  unsigned bits_;
+  H proto_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,223 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_HASH_JOIN_HPP
+#define ORIGIN_HASH_JOIN_HPP
+
+// A partitioned, in-memory hash join [1, 2].
+//
+// The build side is radix partitioned by the digests of its keys (see
+// radix_partition.hpp), so that each partition's table is small enough
+// to stay in cache while it is built. The partitions' tables are built
+// in parallel, with threads taking partitions in turn. Each table is an
+// array of chain heads, indexed by the low bits of the digest (the high
+// bits select the partition), and the chains link the build rows in
+// place. A blocked Bloom filter of the build digests is built at the
+// same time.
+//
+// Probe rows are split between threads and handled in small batches.
+// For each batch, the digests are computed and their filter blocks
+// prefetched; then the filter drops rows that cannot match, and the
+// chain heads of the rest are prefetched; then the chains are walked.
+// Digests are compared before keys, so keys are only compared for
+// likely matches.
+//
+// Inner joins produce every matching (probe, build) pair, semi joins
+// the probe rows with at least one match, and anti joins the probe rows
+// with none. Results are in order of probe rows, whatever the number
+// of threads.
+//
+// [1] C. Balkesen et al. Main-memory hash joins on multi-core CPUs:
+// tuning to the underlying hardware. ICDE 2013.
+//
+// [2] S. Chen et al. Improving hash join performance through
+// prefetching. ICDE 2004.
+
+#include "bloom_filter.hpp"
+#include "radix_partition.hpp"
+
+#include <atomic>
+
+
+namespace origin
+{
+
+enum join_kind { inner_join, semi_join, anti_join };
+
+
+// The result of a join. For inner joins, the i-th match pairs probe row
+// probe[i] with build row build[i], an index into build_rows(). For
+// semi and anti joins, only probe is used.
+struct join_result
+{
+  std::vector<std::size_t> probe;
+  std::vector<std::size_t> build;
+};
+
+
+// A hash join whose build rows have type B and keys of type Key.
+template<typename B, typename Key, Hash_algorithm_64 H = fnv1a>
+  requires Hashable_type<H, Key>()
+class hash_join
+{
+  static constexpr std::size_t none = -1;
+
+public:
+  // The largest number of build rows per partition when the number of
+  // partitions is chosen automatically.
+  static constexpr std::size_t partition_rows = 4096;
+
+  // Create a join with 2^bits build partitions, or a number chosen from
+  // the build size if bits is 0, and a Bloom filter with the given bits
+  // per key, or none if it is 0.
+  explicit hash_join(unsigned bits = 0, double filter_bits = 10, std::uint64_t seed = 0)
+    : bits_(bits), filter_bits_(filter_bits), seed_(seed), hash_(H(seed)), filter_(0)
+  {
+    if (bits > 24 || filter_bits < 0)
+      throw std::invalid_argument("hash_join: bad parameters");
+  }
+
+  // Build the table from rows[0, n), keyed by key(rows[i]), using the
+  // given number of threads. Any previous build is replaced.
+  template<typename K>
+  void build(B const* rows, std::size_t n, K key, unsigned threads = 1)
+  {
+    threads = std::max(1u, threads);
+    unsigned bits = bits_;
+    if (bits == 0)
+      for (bits = 1; bits < 16 && (n >> bits) > partition_rows; ++bits)
+        ;
+    radix_partitioner<B, H> partitioner(bits, 0, seed_);
+    rows_ = partitioner.partition(rows, n, [&key](B const& b) -> Key { return key(b); }, threads);
+    shift_ = 64 - bits;
+
+    std::size_t count = rows_.partitions();
+    offsets_.assign(count + 1, 0);
+    masks_.resize(count);
+    for (std::size_t p = 0; p < count; ++p) {
+      std::size_t m = rows_.bounds[p + 1] - rows_.bounds[p], size = 1;
+      while (size < m)
+        size *= 2;
+      offsets_[p + 1] = offsets_[p] + size;
+      masks_[p] = size - 1;
+    }
+    heads_.assign(offsets_.back(), none);
+    next_.assign(n, none);
+    keys_.resize(n);
+    if (filter_bits_ > 0)
+      filter_ = bloom_filter<H>(n, filter_bits_, seed_);
+
+    // Rows are linked in reverse, so that chains are in order.
+    std::atomic<std::size_t> next(0);
+    radix_detail::run(std::min<std::size_t>(threads, count), [&](std::size_t) {
+      for (std::size_t q; (q = next++) < count; )
+        for (std::size_t i = rows_.bounds[q + 1]; i-- > rows_.bounds[q]; ) {
+          std::uint64_t d = rows_.digests[i];
+          std::size_t s = offsets_[q] + (d & masks_[q]);
+          keys_[i] = key(rows_.items[i]);
+          next_[i] = heads_[s];
+          heads_[s] = i;
+          if (filter_bits_ > 0)
+            filter_.insert_digest_concurrent(d);
+        }
+    });
+  }
+
+  // Probe the table with rows[0, n), keyed by key(rows[i]), using the
+  // given number of threads.
+  template<typename P, typename K>
+  join_result probe(P const* rows, std::size_t n, K key, join_kind kind,
+                    unsigned threads = 1) const
+  {
+    if (heads_.empty())
+      throw std::logic_error("hash_join: not built");
+    threads = std::max(1u, threads);
+    std::size_t chunk = (n + threads - 1) / threads;
+    std::size_t parts = n ? (n + chunk - 1) / chunk : 0;
+    std::vector<join_result> rs(parts);
+    radix_detail::run(parts, [&](std::size_t t) {
+      std::size_t lo = t * chunk, hi = std::min(n, lo + chunk);
+      probe(rows, lo, hi, key, kind, rs[t]);
+    });
+
+    join_result r;
+    for (join_result& x : rs) {
+      r.probe.insert(r.probe.end(), x.probe.begin(), x.probe.end());
+      r.build.insert(r.build.end(), x.build.begin(), x.build.end());
+    }
+    return r;
+  }
+
+  // Returns the build rows, in partition order.
+  cache_aligned_vector<B> const& build_rows() const { return rows_.items; }
+
+  std::size_t size() const { return rows_.items.size(); }
+  std::size_t partitions() const { return masks_.size(); }
+
+private:
+  // Returns the chain head slot for a digest.
+  std::size_t slot(std::uint64_t d) const
+  {
+    std::size_t p = d >> shift_;
+    return offsets_[p] + (d & masks_[p]);
+  }
+
+  // Probe with rows[lo, hi), appending to r.
+  template<typename P, typename K>
+  void probe(P const* rows, std::size_t lo, std::size_t hi, K& key, join_kind kind,
+             join_result& r) const
+  {
+    constexpr std::size_t batch = 16;
+    Key ks[batch];
+    std::uint64_t ds[batch];
+    bool pass[batch];
+    bool filter = filter_bits_ > 0;
+    for (std::size_t b = lo; b < hi; b += batch) {
+      std::size_t m = std::min(batch, hi - b);
+      for (std::size_t k = 0; k < m; ++k) {
+        ks[k] = key(rows[b + k]);
+        ds[k] = hash_mix(hash_(ks[k]));
+        if (filter)
+          filter_.prefetch(ds[k]);
+      }
+      for (std::size_t k = 0; k < m; ++k) {
+        pass[k] = !filter || filter_.contains_digest(ds[k]);
+        if (pass[k])
+          __builtin_prefetch(&heads_[slot(ds[k])]);
+      }
+      for (std::size_t k = 0; k < m; ++k) {
+        bool found = false;
+        if (pass[k])
+          for (std::size_t i = heads_[slot(ds[k])]; i != none; i = next_[i])
+            if (rows_.digests[i] == ds[k] && keys_[i] == ks[k]) {
+              found = true;
+              if (kind != inner_join)
+                break;
+              r.probe.push_back(b + k);
+              r.build.push_back(i);
+            }
+        if ((kind == semi_join && found) || (kind == anti_join && !found))
+          r.probe.push_back(b + k);
+      }
+    }
+  }
+
+  unsigned bits_;
+  double filter_bits_;
+  std::uint64_t seed_;
+  hash<H> hash_;
+  partitioned<B> rows_;
+  unsigned shift_ = 64;
+  std::vector<std::size_t> offsets_;
+  std::vector<std::size_t> masks_;
+  std::vector<std::size_t> heads_;
+  std::vector<std::size_t> next_;
+  std::vector<Key> keys_;
+  bloom_filter<H> filter_;
+};
+
+
+} // namespace origin
+
+
+#endif
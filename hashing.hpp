@@ -25,6 +25,8 @@
 #include <origin/functional.hpp>
 #include <origin/iterator.hpp>
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
 
@@ -146,6 +148,66 @@ struct debug_hasher
 };
 
 
+// A 64-bit hash algorithm is one whose value is (convertible to) a
+// 64-bit unsigned integer. Most of the data structures built on this
+// library consume digests of this form.
+template<typename H>
+concept bool
+Hash_algorithm_64()
+{
+  return Hash_algorithm<H>() && requires(H h) {
+    { h.value() } -> std::uint64_t;
+  };
+}
+
+
+// The 64-bit FNV-1a hash algorithm. This is the algorithm used as the
+// running example in [1]. The algorithm can be seeded, in which case
+// the seed is folded into the offset basis. The default seed produces
+// the standard FNV-1a digest.
+struct fnv1a
+{
+  using value_type = std::uint64_t;
+
+  fnv1a() noexcept = default;
+
+  explicit fnv1a(std::uint64_t seed) noexcept
+    : state_(14695981039346656037ull ^ seed)
+  { }
+
+  void operator()(void const* key, std::size_t len) noexcept
+  {
+    byte const* p = static_cast<byte const*>(key);
+    byte const* const e = p + len;
+    for (; p < e; ++p)
+      state_ = (state_ ^ *p) * 1099511628211ull;
+  }
+
+  value_type value() const noexcept
+  {
+    return state_;
+  }
+
+  std::uint64_t state_ = 14695981039346656037ull;
+};
+
+
+// Returns a well-mixed 64-bit value from a digest. This is the
+// finalizer of MurmurHash3. FNV-1a has poor avalanche in its low bits,
+// so data structures that take indexes from the low bits of a digest
+// (or count leading zeros of it) should apply this first.
+inline std::uint64_t
+hash_mix(std::uint64_t x) noexcept
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+
 // -------------------------------------------------------------------------- //
 // Hash append
 
@@ -252,23 +314,57 @@ hash_append(H& h, T const* first, T const* last)
 }
 
 
+// -------------------------------------------------------------------------- //
+// Standard library types
+
+// Hash append for a vector.
+template<Hash_algorithm H, Hashable_with<H> T, typename A>
+inline void
+hash_append(H& h, std::vector<T, A> const& v)
+{
+  hash_append(h, v.begin(), v.end());
+}
+
+
+// Hash append for a string. The characters are appended as one
+// contiguous block.
+template<Hash_algorithm H, Trivially_comparable C, typename T, typename A>
+inline void
+hash_append(H& h, std::basic_string<C, T, A> const& s)
+{
+  h(s.data(), s.size() * sizeof(C));
+}
+
+
 // -------------------------------------------------------------------------- //
 // Universal hash functions
 
 // The universal hash function produces a hash value for objects
 // that can be hashed with that algorithm.
+//
+// The hash function can be initialized with a prototype algorithm
+// (e.g., a seeded one). Each hash computation starts from a copy of
+// that prototype.
 template<Hash_algorithm H>
 struct hash
 {
-  using result_type = Result_type<H>;
+  using result_type = decltype(std::declval<H&>().value());
+
+  hash() = default;
+
+  explicit hash(H const& h)
+    : proto_(h)
+  { }
 
   template<Hashable_with<H> T>
   result_type operator()(T const& t) const noexcept
   {
-      H hasher;
+      H hasher = proto_;
       hash_append(hasher, t);
-      return hasher;
+      return hasher.value();
   }
+
+  H proto_;
 };
 
 
@@ -0,0 +1,64 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "bloom_filter.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  int const n = 100000;
+  bloom_filter<> f(n, 10, 1);
+
+  // Insert from several threads.
+  std::vector<std::thread> ts;
+  for (int t = 0; t < 4; ++t)
+    ts.emplace_back([&f, t] {
+      for (int i = t; i < n; i += 4)
+        f.insert_concurrent(i);
+    });
+  for (std::thread& t : ts)
+    t.join();
+
+  for (int i = 0; i < n; ++i)
+    assert(f.contains(i));
+
+  int fp = 0;
+  for (int i = n; i < 2 * n; ++i)
+    fp += f.contains(i);
+  double rate = double(fp) / n;
+  std::cout << "false positive rate " << rate << '\n';
+  assert(rate < 0.02);
+
+  // Queries may overlap concurrent inserts.
+  bloom_filter<> g(n, 10, 1);
+  std::thread writer([&g] {
+    for (int i = 0; i < n; ++i)
+      g.insert_concurrent(i);
+  });
+  for (int i = 0; i < n; ++i)
+    g.contains(i);
+  writer.join();
+  for (int i = 0; i < n; ++i)
+    assert(g.contains(i));
+
+  // Merging requires the same size and seed.
+  g.merge(f);
+  try {
+    g.merge(bloom_filter<>(n, 10, 2));
+    assert(false);
+  } catch (std::invalid_argument&) { }
+  try {
+    g.merge(bloom_filter<>(2 * n, 10, 1));
+    assert(false);
+  } catch (std::invalid_argument&) { }
+
+  std::cout << "ok\n";
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "bounded_ring.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <map>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  bounded_load_ring<> r(0.25, 100);
+  for (std::uint64_t n = 0; n < 10; ++n)
+    r.insert(n * 17);
+  assert(r.size() == 10);
+
+  // Plain lookups are consistent: removing a node only moves its keys.
+  bounded_load_ring<> s = r;
+  s.erase(34);
+  for (int k = 0; k < 100000; ++k) {
+    std::uint64_t a = r.lookup(k), b = s.lookup(k);
+    assert(a == b || a == 34);
+  }
+
+  // A skewed workload: half of the assignments are one hot key. No node
+  // exceeds the capacity.
+  std::map<std::uint64_t, int> count;
+  const int m = 100000;
+  for (int k = 0; k < m; ++k) {
+    int key = k % 2 ? 42 : k;
+    std::uint64_t n = r.assign(key);
+    ++count[n];
+  }
+  assert(r.total() == std::size_t(m));
+  std::size_t cap = r.capacity(m);
+  std::size_t most = 0;
+  for (auto const& kv : count) {
+    assert(std::size_t(kv.second) == r.load(kv.first));
+    most = std::max<std::size_t>(most, kv.second);
+  }
+  std::cout << "max load: " << most << " capacity: " << cap
+            << " average: " << m / 10 << '\n';
+  assert(most <= cap);
+  assert(count.size() == 10);
+
+  // Without the hot key, most keys stay with their owner.
+  bounded_load_ring<> t(0.25, 100);
+  for (std::uint64_t n = 0; n < 10; ++n)
+    t.insert(n * 17);
+  int home = 0;
+  for (int k = 0; k < m; ++k)
+    home += t.assign(k) == t.lookup(k);
+  std::cout << "assigned to owner: " << double(home) / m << '\n';
+  assert(home > 0.8 * m);
+
+  // Releasing load.
+  std::uint64_t n = t.assign(7);
+  std::size_t before = t.load(n);
+  t.release(n);
+  assert(t.load(n) == before - 1);
+
+  // Erasing a node drops its load.
+  t.erase(n);
+  assert(t.total() == std::size_t(m) - before + 1);
+
+  std::cout << "ok\n";
+}
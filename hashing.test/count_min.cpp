@@ -0,0 +1,64 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "count_min.hpp"
+
+#include <cassert>
+#include <iostream>
+
+
+using namespace origin;
+
+
+// A Zipf-like stream: key k occurs about n / (k + 1) times.
+std::vector<int>
+stream(int n)
+{
+  std::vector<int> s;
+  for (int k = 0; k < n; ++k)
+    for (int i = 0; i < n / (k + 1); ++i)
+      s.push_back(k);
+  return s;
+}
+
+
+template<typename C>
+double
+error(bool conservative, std::vector<int> const& s, int n)
+{
+  // Two shards merged by addition.
+  auto a = count_min_sketch<C>::with_error(0.001, 0.01, conservative);
+  auto b = count_min_sketch<C>::with_error(0.001, 0.01, conservative);
+  a.insert(s.begin(), s.begin() + s.size() / 2);
+  b.insert(s.begin() + s.size() / 2, s.end());
+  a.merge(b);
+
+  double err = 0;
+  for (int k = 0; k < n; ++k) {
+    std::uint64_t truth = n / (k + 1);
+    std::uint64_t e = a.estimate(k);
+    assert(e >= std::min<std::uint64_t>(truth, std::numeric_limits<C>::max()));
+    err += e - truth;
+  }
+  return err / n;
+}
+
+
+int
+main()
+{
+  int const n = 20000;
+  std::vector<int> s = stream(n);
+
+  double plain = error<std::uint32_t>(false, s, n);
+  double cons = error<std::uint32_t>(true, s, n);
+  std::cout << "mean overestimate: " << plain << " plain, " << cons << " conservative\n";
+  assert(cons <= plain);
+
+  // Saturating 8-bit counters.
+  count_min_sketch<std::uint8_t> c(1024, 4);
+  c.insert(1, 1000);
+  assert(c.estimate(1) == 255);
+
+  std::cout << "ok\n";
+}
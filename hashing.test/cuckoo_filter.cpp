@@ -0,0 +1,72 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "cuckoo_filter.hpp"
+
+#include <cassert>
+#include <iostream>
+
+
+using namespace origin;
+
+
+template<unsigned Bits>
+void
+test()
+{
+  int const n = 200000;
+
+  // Start small to force the filter to grow.
+  cuckoo_filter<Bits> f(n / 16);
+  std::vector<int> keys;
+  for (int i = 0; i < n; ++i)
+    keys.push_back(i);
+  f.insert(keys.begin(), keys.end());
+  assert(f.size() == std::size_t(n));
+
+  std::vector<char> found(n);
+  f.contains(keys.begin(), keys.end(), found.begin());
+  for (int i = 0; i < n; ++i)
+    assert(found[i]);
+
+  for (int i = 0; i < n; i += 2)
+    assert(f.erase(i));
+  for (int i = 1; i < n; i += 2)
+    assert(f.contains(i));
+
+  int fp = 0;
+  for (int i = n; i < 2 * n; ++i)
+    fp += f.contains(i);
+  std::cout << Bits << "-bit: " << f.table_count() << " tables, "
+            << 8.0 * f.size_in_bytes() / n << " bits/key, "
+            << "false positive rate " << double(fp) / n << std::endl;
+  assert(double(fp) / n <= 8.0 * f.table_count() / (1 << Bits));
+}
+
+
+// Inserting a key again adds a copy, up to the 8 slots of its buckets,
+// without growing the filter.
+void
+test_copies()
+{
+  cuckoo_filter<> f(64);
+  int inserted = 0;
+  for (int i = 0; i < 100; ++i)
+    inserted += f.insert(42);
+  assert(inserted == 8 && f.size() == 8 && f.table_count() == 1);
+  for (int i = 0; i < 8; ++i)
+    assert(f.erase(42));
+  assert(!f.contains(42) && f.size() == 0);
+  assert(f.insert(42));
+}
+
+
+int
+main()
+{
+  test_copies();
+  test<8>();
+  test<12>();
+  test<16>();
+  std::cout << "ok\n";
+}
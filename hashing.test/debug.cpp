@@ -30,24 +30,6 @@ operator<<(std::ostream& os, std::vector<byte> const& buf)
 }
 
 
-// Hash for a vector.
-template<Hash_algorithm H, Hashable_with<H> T, typename A>
-void
-hash_append(H& h, std::vector<T, A> const& v)
-{
-  hash_append(h, v.begin(), v.end());
-}
-
-
-// Hash for a string.
-template<Hash_algorithm H, Hashable_with<H> C, typename T, typename A>
-void
-hash_append(H& h, std::basic_string<C, T, A> const& s)
-{
-  hash_append(h, s.begin(), s.end());
-}
-
-
 int
 main()
 {
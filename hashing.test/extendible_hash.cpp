@@ -0,0 +1,62 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "extendible_hash.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  using index = extendible_hash<long, long>;
+  char dir[] = "/tmp/origin.extendible_hash.XXXXXX";
+  if (!mkdtemp(dir))
+    return 1;
+  std::string path = std::string(dir) + "/index";
+
+  {
+    // A small page and cache force many splits and evictions.
+    index t = index::create(path, 42, 8, 256);
+    for (long i = 0; i < 20000; ++i)
+      assert(t.insert(i, i * i));
+    assert(!t.insert(7, -7));
+    for (long i = 0; i < 20000; i += 2)
+      assert(t.erase(i));
+  }
+
+  // A process that splits and evicts pages and then dies without
+  // flushing loses none of the flushed entries.
+  pid_t pid = fork();
+  if (pid == 0) {
+    index t = index::open(path, 8);
+    for (long i = 20000; i < 60000; ++i)
+      t.insert(i, i);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  {
+    index t = index::open(path, 8);
+    for (long i = 0; i < 20000; ++i) {
+      long v;
+      bool found = t.find(i, v);
+      assert(found == (i % 2 == 1));
+      if (found)
+        assert(v == (i == 7 ? -7 : i * i));
+    }
+  }
+
+  std::system((std::string("rm -rf ") + dir).c_str());
+  std::cout << "ok\n";
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "external_dedup.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+
+#include <dirent.h>
+
+
+using namespace origin;
+
+
+// Returns the number of files in dir, besides . and ..
+int
+count_files(char const* dir)
+{
+  DIR* d = opendir(dir);
+  int n = 0;
+  while (dirent* e = readdir(d))
+    n += e->d_name[0] != '.';
+  closedir(d);
+  return n;
+}
+
+
+// Deduplicate the records with the given budget, checking that each
+// distinct record is emitted exactly once. Returns the number of spills.
+std::size_t
+check(char const* dir, std::vector<std::string> const& in, std::size_t budget)
+{
+  std::set<std::string> expect(in.begin(), in.end());
+  std::set<std::string> seen;
+  external_dedup<> d(dir, budget);
+  for (std::string const& r : in)
+    d.insert(r);
+  d.finish([&](std::string const& r) {
+    assert(expect.count(r));
+    assert(seen.insert(r).second);
+  });
+  assert(seen.size() == expect.size());
+  assert(count_files(dir) == 0);
+  return d.spills();
+}
+
+
+int
+main()
+{
+  char dir[] = "/tmp/origin.external_dedup.XXXXXX";
+  if (!mkdtemp(dir))
+    return 1;
+
+  std::vector<std::string> in;
+  for (std::size_t i = 0; i < 200000; ++i)
+    in.push_back("GET /item/" + std::to_string((i * 7919) % 50000) + " HTTP/1.1");
+
+  // Everything fits in memory.
+  assert(check(dir, in, 64 << 20) == 0);
+
+  // One level of runs, then several.
+  std::size_t one = check(dir, in, 1 << 20);
+  std::size_t many = check(dir, in, 8192);
+  assert(one > 0 && many > one);
+
+  // Records larger than the run buffers, and empty records.
+  std::vector<std::string> big;
+  for (int i = 0; i < 300; ++i)
+    big.push_back(std::string(100 + i % 50 * 37, 'a' + i % 26));
+  big.push_back("");
+  big.push_back("");
+  assert(check(dir, big, 4096) > 0);
+
+  assert(check(dir, {}, 4096) == 0);
+
+  // Records larger than the set's share of the budget.
+  check(dir, {std::string(3000, 'x'), "small"}, 4096);
+  check(dir, {std::string(3000, 'x'), std::string(3000, 'x'), std::string(5000, 'y'),
+              std::string(3000, 'z'), "small", std::string(5000, 'y')}, 4096);
+
+  try {
+    external_dedup<>(dir, 100);
+    assert(false);
+  } catch (std::invalid_argument&) { }
+
+  std::system((std::string("rm -rf ") + dir).c_str());
+  std::cout << "ok\n";
+}
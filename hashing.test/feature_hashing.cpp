@@ -0,0 +1,75 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "feature_hashing.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+
+using namespace origin;
+
+using row = std::vector<feature<std::string, std::string>>;
+
+
+int
+main()
+{
+  feature_hasher<> fh(20);
+
+  // Namespaces separate equal names, and are not confused by
+  // concatenation.
+  std::uint64_t a = fh.space(std::string("ab")), b = fh.space(std::string("a"));
+  assert(fh(a, std::string("c")).column != fh(b, std::string("bc")).column);
+
+  std::vector<row> rows;
+  for (int i = 0; i < 1000; ++i) {
+    row r;
+    for (int j = 0; j < 10; ++j)
+      r.push_back({"word", "w" + std::to_string(i * 7 + j), 1});
+    r.push_back({"user", "u" + std::to_string(i % 13), 2.5f});
+    rows.push_back(r);
+  }
+  rows.push_back({});
+
+  csr_matrix m = fh.transform(rows.begin(), rows.end());
+  assert(m.rows() == rows.size());
+  assert(m.cols == 1u << 20);
+  assert(m.offsets.back() == m.nonzeros());
+  for (std::size_t i = 0; i < m.rows(); ++i)
+    for (std::size_t k = m.offsets[i] + 1; k < m.offsets[i + 1]; ++k)
+      assert(m.columns[k - 1] < m.columns[k]);
+  assert(m.offsets[1] - m.offsets[0] <= 11);
+  assert(m.offsets[m.rows()] == m.offsets[m.rows() - 1]);
+
+  // Values carry the sign of their column.
+  std::uint64_t user = fh.space(std::string("user"));
+  auto s = fh(user, std::string("u0"));
+  for (std::size_t k = m.offsets[0]; k < m.offsets[1]; ++k)
+    if (m.columns[k] == s.column)
+      assert(m.values[k] == 2.5f * s.sign);
+
+  // Parallel output is identical.
+  csr_matrix p = fh.transform(rows.begin(), rows.end(), 4);
+  assert(p.offsets == m.offsets && p.columns == m.columns && p.values == m.values);
+
+  // Appending.
+  fh.transform(rows.begin(), rows.begin() + 10, p);
+  assert(p.rows() == rows.size() + 10);
+
+  // Duplicate features are summed; opposite values cancel.
+  std::vector<row> dup {{{"x", "f", 1}, {"x", "f", 2}}, {{"x", "f", 1}, {"x", "f", -1}}};
+  csr_matrix d = fh.transform(dup.begin(), dup.end());
+  assert(d.nonzeros() == 1 && std::abs(d.values[0]) == 3);
+
+  // Signs are balanced.
+  int pos = 0;
+  for (int i = 0; i < 10000; ++i)
+    pos += fh(a, i).sign > 0;
+  std::cout << "positive: " << pos << '\n';
+  assert(pos > 4700 && pos < 5300);
+
+  std::cout << "ok\n";
+}
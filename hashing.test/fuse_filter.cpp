@@ -0,0 +1,55 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "fuse_filter.hpp"
+
+#include <cassert>
+#include <iostream>
+
+
+using namespace origin;
+
+
+template<typename F>
+void
+test(std::vector<long> const& keys)
+{
+  binary_fuse_filter<F> f(keys.begin(), keys.end(), 4);
+  for (long k : keys)
+    assert(f.contains(k));
+
+  // Query a serialized copy in place.
+  std::vector<std::uint64_t> image((f.image_size() + 7) / 8);
+  f.serialize(image.data());
+  binary_fuse_view<F> v(image.data(), f.image_size());
+  for (long k : keys)
+    assert(v.contains(k));
+
+  long n = keys.size();
+  long fp = 0;
+  for (long k = n; k < 2 * n; ++k)
+    fp += v.contains(k);
+  std::cout << 8 * sizeof(F) << "-bit: "
+            << 8.0 * f.size_in_bytes() / n << " bits/key, "
+            << "false positive rate " << double(fp) / n << std::endl;
+  if (n >= 1000)
+    assert(double(fp) / n < 2.0 / (1 << (8 * sizeof(F))) + 0.001);
+}
+
+
+int
+main()
+{
+  std::vector<long> keys;
+  for (long i = 0; i < 1000000; ++i)
+    keys.push_back(i);
+  keys.push_back(42); // Duplicates are allowed.
+
+  test<std::uint8_t>(keys);
+  test<std::uint16_t>(keys);
+
+  std::vector<long> few {1, 2, 3};
+  test<std::uint8_t>(few);
+
+  std::cout << "ok\n";
+}
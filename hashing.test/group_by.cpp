@@ -0,0 +1,97 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "group_by.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <map>
+
+
+using namespace origin;
+
+
+struct sale
+{
+  std::uint32_t store;
+  std::uint32_t item;
+  std::int64_t amount;
+};
+
+
+using key_type = std::tuple<std::uint32_t, std::uint32_t>;
+
+
+// Check the groups against a sequential aggregation with std::map.
+void
+check(std::vector<group<key_type, std::int64_t>> const& gs, std::vector<sale> const& rows)
+{
+  std::map<key_type, group<key_type, std::int64_t>> expect;
+  for (sale const& s : rows) {
+    key_type k(s.store, s.item);
+    auto iter = expect.find(k);
+    if (iter == expect.end())
+      expect.emplace(k, group<key_type, std::int64_t>{k, s.amount, 1, s.amount, s.amount});
+    else {
+      iter->second.sum += s.amount;
+      ++iter->second.count;
+      iter->second.min = std::min(iter->second.min, s.amount);
+      iter->second.max = std::max(iter->second.max, s.amount);
+    }
+  }
+  assert(gs.size() == expect.size());
+  std::map<key_type, int> seen;
+  for (group<key_type, std::int64_t> const& g : gs) {
+    group<key_type, std::int64_t> const& e = expect.at(g.key);
+    assert(g.sum == e.sum && g.count == e.count && g.min == e.min && g.max == e.max);
+    assert(++seen[g.key] == 1);
+  }
+}
+
+
+int
+main()
+{
+  const std::size_t n = 1 << 20;
+  auto key = [](sale const& s) { return key_type(s.store, s.item); };
+  auto value = [](sale const& s) { return s.amount; };
+
+  // Few groups: the local tables never fill.
+  std::vector<sale> low(n);
+  for (std::size_t i = 0; i < n; ++i)
+    low[i] = {std::uint32_t(i % 10), std::uint32_t(i % 7), std::int64_t(i % 1000) - 500};
+  group_by<key_type, std::int64_t> agg;
+  check(agg(low.data(), n, key, value), low);
+  check(agg(low.data(), n, key, value, 4), low);
+
+  // Many groups: the local tables spill repeatedly.
+  std::vector<sale> high(n);
+  for (std::size_t i = 0; i < n; ++i)
+    high[i] = {std::uint32_t((i * 2654435761u) % 100000), std::uint32_t(i % 3), std::int64_t(i)};
+  for (unsigned threads : {1, 3, 4}) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<group<key_type, std::int64_t>> gs = agg(high.data(), n, key, value, threads);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+    std::cout << threads << " threads, " << gs.size() << " groups: " << ns << " ns/row\n";
+    check(gs, high);
+  }
+
+  // Tiny local tables and a single partition.
+  group_by<key_type, std::int64_t> tiny(1, 0);
+  check(tiny(high.data(), 10000, key, value, 2), std::vector<sale>(high.begin(), high.begin() + 10000));
+
+  // Single-field keys.
+  std::vector<std::uint64_t> xs = {5, 3, 5, 5, 3, 9};
+  group_by<std::tuple<std::uint64_t>> count;
+  std::vector<group<std::tuple<std::uint64_t>, double>> cs =
+    count(xs.data(), xs.size(), [](std::uint64_t x) { return std::make_tuple(x); },
+          [](std::uint64_t) { return 1.0; }, 2);
+  assert(cs.size() == 3);
+  for (auto const& g : cs)
+    assert(g.count == std::size_t(std::get<0>(g.key) == 5 ? 3 : std::get<0>(g.key) == 3 ? 2 : 1));
+
+  assert(agg(low.data(), 0, key, value, 4).empty());
+
+  std::cout << "ok\n";
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "hash_join.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <unordered_map>
+
+
+using namespace origin;
+
+
+struct order
+{
+  std::uint64_t customer;
+  std::uint64_t amount;
+};
+
+
+struct customer
+{
+  std::uint64_t id;
+  std::uint32_t region;
+};
+
+
+int
+main()
+{
+  // Customers 0 to n - 1, with every tenth id repeated, and orders for
+  // customers n / 2 to 3n / 2.
+  const std::size_t n = 200000;
+  std::vector<customer> cs;
+  for (std::size_t i = 0; i < n; ++i) {
+    cs.push_back({i, std::uint32_t(i % 7)});
+    if (i % 10 == 0)
+      cs.push_back({i, 100});
+  }
+  std::vector<order> os;
+  for (std::size_t i = 0; i < n; ++i)
+    os.push_back({n / 2 + (i * 7919) % n, i});
+  auto ckey = [](customer const& c) { return c.id; };
+  auto okey = [](order const& o) { return o.customer; };
+
+  std::unordered_map<std::uint64_t, std::size_t> counts;
+  for (customer const& c : cs)
+    ++counts[c.id];
+  std::size_t pairs = 0, matched = 0;
+  for (order const& o : os)
+    if (counts.count(o.customer)) {
+      pairs += counts[o.customer];
+      ++matched;
+    }
+
+  hash_join<customer, std::uint64_t> join;
+  join.build(cs.data(), cs.size(), ckey, 4);
+  assert(join.size() == cs.size());
+  assert(join.partitions() > 1);
+
+  auto start = std::chrono::steady_clock::now();
+  join_result inner = join.probe(os.data(), os.size(), okey, inner_join, 4);
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / os.size();
+  std::cout << "inner join probe: " << ns << " ns/row\n";
+  assert(inner.probe.size() == pairs && inner.build.size() == pairs);
+  for (std::size_t i = 0; i < pairs; ++i) {
+    assert(i == 0 || inner.probe[i - 1] <= inner.probe[i]);
+    assert(join.build_rows()[inner.build[i]].id == os[inner.probe[i]].customer);
+  }
+
+  join_result semi = join.probe(os.data(), os.size(), okey, semi_join, 4);
+  join_result anti = join.probe(os.data(), os.size(), okey, anti_join, 4);
+  assert(semi.probe.size() == matched);
+  assert(anti.probe.size() == os.size() - matched);
+  assert(semi.build.empty());
+  for (std::size_t i : semi.probe)
+    assert(counts.count(os[i].customer));
+  for (std::size_t i : anti.probe)
+    assert(!counts.count(os[i].customer));
+
+  // The result does not depend on the threads, partitions or filter.
+  hash_join<customer, std::uint64_t> plain(3, 0);
+  plain.build(cs.data(), cs.size(), ckey);
+  assert(plain.partitions() == 8);
+  join_result x = plain.probe(os.data(), os.size(), okey, inner_join);
+  assert(x.probe == inner.probe);
+  for (std::size_t i = 0; i < pairs; ++i)
+    assert(plain.build_rows()[x.build[i]].region == join.build_rows()[inner.build[i]].region);
+  assert(plain.probe(os.data(), os.size(), okey, anti_join, 3).probe == anti.probe);
+
+  // An empty build side matches nothing.
+  hash_join<customer, std::uint64_t> empty;
+  empty.build(cs.data(), 0, ckey, 4);
+  assert(empty.probe(os.data(), os.size(), okey, inner_join, 2).probe.empty());
+  assert(empty.probe(os.data(), os.size(), okey, anti_join, 2).probe.size() == os.size());
+
+  try {
+    hash_join<customer, std::uint64_t>().probe(os.data(), 1, okey, semi_join);
+    assert(false);
+  } catch (std::logic_error&) { }
+
+  std::cout << "ok\n";
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "hyperloglog.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  // The word-wide maximum agrees with the lane-by-lane maximum.
+  std::uint64_t x = 1;
+  for (int i = 0; i < 100000; ++i) {
+    std::uint64_t a = (x = hash_mix(x)) & hll_registers::lanes;
+    std::uint64_t b = (x = hash_mix(x)) & hll_registers::lanes;
+    std::uint64_t m = hll_registers::max(a, b);
+    for (unsigned k = 0; k < hll_registers::per_word; ++k) {
+      unsigned s = k * hll_registers::width;
+      assert(((m >> s) & 63) == std::max((a >> s) & 63, (b >> s) & 63));
+    }
+  }
+
+  // Count with one sketch per thread, then merge.
+  for (long n : {100L, 10000L, 1000000L}) {
+    std::vector<hyperloglog<>> parts(4);
+    std::vector<std::thread> ts;
+    for (int t = 0; t < 4; ++t)
+      ts.emplace_back([&parts, n, t] {
+        for (long i = t; i < n; i += 4)
+          parts[t].insert(i);
+      });
+    for (std::thread& t : ts)
+      t.join();
+
+    hyperloglog<> h;
+    for (hyperloglog<> const& p : parts)
+      h.merge(p);
+    double e = h.estimate();
+    std::cout << n << ": " << e << (h.is_sparse() ? " (sparse)" : " (dense)") << '\n';
+    assert(std::abs(e - n) / n < 0.05);
+
+    std::vector<byte> buf = h.serialize();
+    hyperloglog<> r = hyperloglog<>::deserialize(buf.data(), buf.size());
+    assert(r.estimate() == e);
+  }
+
+  // Sketches with different seeds do not merge, and the seed is part of
+  // the serialization.
+  hyperloglog<> a(14, 1), b(14, 2);
+  a.insert(1);
+  b.insert(1);
+  bool threw = false;
+  try { a.merge(b); } catch (std::invalid_argument&) { threw = true; }
+  assert(threw);
+  std::vector<byte> buf = a.serialize();
+  assert(hyperloglog<>::deserialize(buf.data(), buf.size(), 1).estimate() == a.estimate());
+  threw = false;
+  try { hyperloglog<>::deserialize(buf.data(), buf.size(), 2); } catch (std::runtime_error&) { threw = true; }
+  assert(threw);
+
+  // Sparse pairs must have strictly increasing indices.
+  std::vector<byte> pairs = {2, 14, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0xc8, 0x01, 0x80, 0x01};
+  assert(hyperloglog<>::deserialize(pairs.data(), pairs.size()).estimate() > 0);
+  pairs.pop_back();
+  pairs.back() = 0;
+  threw = false;
+  try { hyperloglog<>::deserialize(pairs.data(), pairs.size()); } catch (std::runtime_error&) { threw = true; }
+  assert(threw);
+
+  std::cout << "ok\n";
+}
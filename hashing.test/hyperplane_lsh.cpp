@@ -0,0 +1,69 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "hyperplane_lsh.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  const std::size_t dim = 100, n = 2000;
+  std::mt19937 rng(1);
+  std::normal_distribution<float> g;
+
+  // Random vectors, and a small perturbation of each.
+  std::vector<float> xs(n * dim), ys(n * dim);
+  for (std::size_t i = 0; i < n * dim; ++i) {
+    xs[i] = g(rng);
+    ys[i] = xs[i] + 0.1f * g(rng);
+  }
+  std::vector<std::uint64_t> ids(n);
+  for (std::size_t i = 0; i < n; ++i)
+    ids[i] = i;
+
+  hyperplane_lsh<> a(dim, 12, 8, 5), b(dim, 12, 8, 5);
+  for (std::size_t i = 0; i < n; ++i)
+    a.insert(ids[i], &xs[i * dim]);
+  b.insert(ids.data(), xs.data(), n, 4);
+  assert(a.size() == n && b.size() == n);
+
+  // The same seed gives the same hyperplanes.
+  for (std::size_t t = 0; t < 8; ++t)
+    assert(a.signature(&xs[0], t) == b.signature(&xs[0], t));
+
+  // Scaling does not change the signature.
+  std::vector<float> s(&xs[0], &xs[dim]);
+  for (float& f : s)
+    f *= 3;
+  assert(a.signature(s.data(), 0) == a.signature(&xs[0], 0));
+
+  std::size_t hits = 0, total = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    std::vector<std::uint64_t> c = a.query(&ys[i * dim]);
+    assert(c == b.query(&ys[i * dim]));
+    hits += std::binary_search(c.begin(), c.end(), i);
+    total += c.size();
+  }
+  double recall = double(hits) / n, mean = double(total) / n;
+  std::cout << "recall: " << recall << " candidates: " << mean << std::endl;
+  assert(recall > 0.9);
+  assert(mean < 50);
+
+  // Dimensions that are a multiple of the block size. Negating a
+  // vector flips every bit.
+  hyperplane_lsh<> c(128, 64, 1);
+  std::vector<float> v(128), w(128);
+  for (std::size_t i = 0; i < 128; ++i)
+    w[i] = -(v[i] = g(rng));
+  assert(c.signature(v.data(), 0) == ~c.signature(w.data(), 0));
+
+  std::cout << "ok\n";
+}
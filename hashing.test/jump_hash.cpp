@@ -0,0 +1,82 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "jump_hash.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+
+using namespace origin;
+
+
+using clock_type = std::chrono::steady_clock;
+
+
+double
+nanoseconds(clock_type::time_point start, std::size_t n)
+{
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / n;
+}
+
+
+int
+main()
+{
+  const std::size_t n = 1000000;
+  std::vector<std::uint64_t> keys(n);
+  for (std::size_t i = 0; i < n; ++i)
+    keys[i] = i;
+
+  // One bucket takes every key.
+  for (std::uint64_t k = 0; k < 1000; ++k)
+    assert(jump_consistent_hash(k, 1) == 0);
+
+  jump_hash<> j(4096);
+  std::vector<std::int32_t> a(n), scalar(n);
+
+  auto start = clock_type::now();
+  for (std::size_t i = 0; i < n; ++i)
+    scalar[i] = j(keys[i]);
+  double ts = nanoseconds(start, n);
+  start = clock_type::now();
+  j.assign(keys.data(), n, a.data());
+  double tb = nanoseconds(start, n);
+  std::cout << "assign: scalar " << ts << " ns/key, bulk " << tb << " ns/key\n";
+  assert(a == scalar);
+
+  // Buckets are balanced.
+  std::vector<std::size_t> load(4096);
+  for (std::int32_t b : a) {
+    assert(b >= 0 && b < 4096);
+    ++load[b];
+  }
+  auto mm = std::minmax_element(load.begin(), load.end());
+  std::cout << "load: min " << *mm.first << " max " << *mm.second
+            << " (mean " << n / 4096 << ")\n";
+
+  // Keys moved when the bucket count changes. Growing from n to m
+  // buckets should move (m - n) / m of the keys, all to new buckets.
+  std::cout << "buckets       moved    expected\n";
+  for (std::int32_t m : {4095, 4097, 4100, 4608, 6144, 8192}) {
+    jump_hash<> k(m);
+    std::vector<std::int32_t> b(n);
+    k.assign(keys.data(), n, b.data());
+    std::size_t moved = 0;
+    for (std::size_t i = 0; i < n; ++i)
+      if (a[i] != b[i]) {
+        ++moved;
+        if (m > 4096)
+          assert(b[i] >= 4096);
+        else
+          assert(a[i] == 4095);
+      }
+    double f = double(moved) / n;
+    double e = double(std::abs(m - 4096)) / std::max(m, 4096);
+    std::cout << "4096 -> " << m << "  " << f << "  " << e << '\n';
+    assert(f < e * 1.1 + 0.001);
+  }
+
+  std::cout << "ok\n";
+}
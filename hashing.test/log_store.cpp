@@ -0,0 +1,46 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "log_store.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  char dir[] = "/tmp/origin.log_store.XXXXXX";
+  if (!mkdtemp(dir))
+    return 1;
+
+  log_store<>::options opts;
+  opts.max_segment_size = 4096;
+  {
+    log_store<> s(dir, opts);
+    for (int i = 0; i < 1000; ++i)
+      s.put("key" + std::to_string(i), std::string(i % 50, 'a' + i % 26));
+    for (int i = 0; i < 1000; i += 3)
+      assert(s.erase("key" + std::to_string(i)));
+    for (int i = 1; i < 1000; i += 3)
+      s.put("key" + std::to_string(i), "updated");
+    s.compact_async().get();
+    s.erase("key1");
+  }
+
+  // Reopen from hint files and the remaining segments.
+  log_store<> s(dir, opts);
+  assert(s.size() == 666 - 1);
+  std::string v;
+  assert(!s.get("key0", v));
+  assert(!s.get("key1", v));
+  assert(s.get("key4", v) && v == "updated");
+  assert(s.get("key5", v) && v == std::string(5, 'a' + 5));
+
+  std::system((std::string("rm -rf ") + dir).c_str());
+  std::cout << "ok\n";
+}
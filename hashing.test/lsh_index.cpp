@@ -0,0 +1,69 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "lsh_index.hpp"
+
+#include <cassert>
+#include <iostream>
+
+
+using namespace origin;
+
+
+// Document i is the set {1000 * (i / 2) + j : j < 100}, with the odd
+// documents altered in 5 places, so documents 2k and 2k + 1 are near
+// duplicates (Jaccard ~0.9) and all other pairs are disjoint.
+std::vector<int>
+document(int i)
+{
+  std::vector<int> d;
+  for (int j = 0; j < 100; ++j)
+    d.push_back(1000 * (i / 2) + ((i % 2 && j < 5) ? 500 + j : j));
+  return d;
+}
+
+
+int
+main()
+{
+  const int n = 200;
+  minhash<> mh(128);
+  std::vector<std::uint64_t> ids;
+  std::vector<minhash_signature> sigs;
+  for (int i = 0; i < n; ++i) {
+    std::vector<int> d = document(i);
+    ids.push_back(i);
+    sigs.push_back(mh(d.begin(), d.end()));
+  }
+
+  // 32 bands of 4 rows: threshold ~0.42.
+  std::cout << "threshold: " << lsh_index<>::threshold(32, 4) << '\n';
+  lsh_index<> a(32, 4), b(32, 4);
+  for (int i = 0; i < n; ++i)
+    a.insert(ids[i], sigs[i]);
+  b.insert(ids, sigs, 4);
+  assert(a.size() == n && b.size() == n);
+
+  for (int i = 0; i < n; ++i) {
+    std::vector<std::uint64_t> c = a.query(sigs[i]);
+    assert(c == b.query(sigs[i]));
+    assert(c.size() == 2);
+    assert(c[0] == std::uint64_t(i & ~1) && c[1] == std::uint64_t(i | 1));
+  }
+
+  auto pairs = b.candidate_pairs();
+  assert(pairs == a.candidate_pairs());
+  assert(pairs.size() == n / 2);
+  for (auto const& p : pairs)
+    assert(p.first % 2 == 0 && p.second == p.first + 1);
+
+  try {
+    a.query(minhash_signature(64));
+    assert(false);
+  } catch (std::invalid_argument const&) { }
+
+  a.clear();
+  assert(a.query(sigs[0]).empty());
+
+  std::cout << "ok\n";
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "maglev.hpp"
+
+#include <cassert>
+#include <iostream>
+
+
+using namespace origin;
+
+
+// Returns the number of entries that differ between two tables, using
+// lookups of the keys [0, n).
+template<typename T>
+int
+changed(T const& a, T const& b, int n)
+{
+  int c = 0;
+  for (int k = 0; k < n; ++k)
+    c += a(k) != b(k);
+  return c;
+}
+
+
+// Every backend has between (1 - r) M / N and (1 + r) M / N entries.
+template<typename T>
+bool
+balanced(T const& t, double r)
+{
+  double share = double(t.size()) / t.backends().size();
+  for (std::size_t c : t.counts())
+    if (c < (1 - r) * share || c > (1 + r) * share)
+      return false;
+  return true;
+}
+
+
+int
+main()
+{
+  try {
+    maglev_table<> bad(1000);
+    assert(false);
+  } catch (std::invalid_argument const&) { }
+
+  const int keys = 200000;
+  maglev_table<> t(65537);
+  for (std::uint64_t b = 0; b < 10; ++b)
+    t.insert(b * 101);
+  assert(balanced(t, 0.05));
+
+  // A rebuilt table does not depend on insertion order.
+  maglev_table<> u(65537);
+  for (std::uint64_t b = 10; b-- > 0; )
+    u.insert(b * 101);
+  t.rebuild();
+  u.rebuild();
+  assert(changed(t, u, keys) == 0);
+  assert(balanced(t, 0.01));
+
+  // Removing a backend moves only its own keys.
+  maglev_table<> v = t;
+  v.erase(303);
+  assert(v.backends().size() == 9);
+  assert(balanced(v, 0.02));
+  int moved = 0;
+  for (int k = 0; k < keys; ++k)
+    if (t(k) != v(k)) {
+      assert(t(k) == 303);
+      ++moved;
+    }
+  std::cout << "erase: moved " << double(moved) / keys << '\n';
+
+  // Adding a backend moves about 1/N of the keys, all to it.
+  maglev_table<> w = t;
+  w.insert(7777);
+  assert(balanced(w, 0.02));
+  moved = 0;
+  for (int k = 0; k < keys; ++k)
+    if (t(k) != w(k)) {
+      assert(w(k) == 7777);
+      ++moved;
+    }
+  std::cout << "insert: moved " << double(moved) / keys << '\n';
+  assert(double(moved) / keys < 0.1);
+
+  // A full rebuild, for comparison, also moves about 1/N of the keys.
+  maglev_table<> x = w;
+  x.rebuild();
+  double rebuilt = double(changed(t, x, keys)) / keys;
+  std::cout << "rebuild: moved " << rebuilt << '\n';
+  assert(rebuilt < 0.15);
+
+  // Down to one backend, and back.
+  maglev_table<> y(13);
+  y.insert(1);
+  for (int k = 0; k < 100; ++k)
+    assert(y(k) == 1);
+  y.insert(2);
+  y.erase(1);
+  for (int k = 0; k < 100; ++k)
+    assert(y(k) == 2);
+
+  std::cout << "ok\n";
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "minhash.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+
+using namespace origin;
+
+
+// Two sets of n integers sharing s elements; their Jaccard similarity
+// is s / (2n - s).
+void
+check(minhash<>::scheme sch, int n, int s)
+{
+  std::vector<int> a, b;
+  for (int i = 0; i < n; ++i) {
+    a.push_back(i);
+    b.push_back(i < s ? i : n + i);
+  }
+  double j = double(s) / (2 * n - s);
+
+  minhash<> mh(512, sch, 7);
+  minhash_signature x = mh(a.begin(), a.end());
+  minhash_signature y = mh(b.begin(), b.end());
+  double e = similarity(x, y);
+  std::cout << "  n=" << n << " J=" << j << " est=" << e;
+  assert(std::abs(e - j) < 0.1);
+
+  // Compressed signatures.
+  for (unsigned bits : {1u, 4u, 13u, 32u}) {
+    double eb = similarity(compress(x, bits), compress(y, bits));
+    std::cout << " b" << bits << '=' << eb;
+    assert(std::abs(eb - j) < (bits == 1 ? 0.2 : 0.12));
+  }
+  std::cout << std::endl;
+
+  // Order does not matter.
+  std::vector<int> r(a.rbegin(), a.rend());
+  assert(mh(r.begin(), r.end()) == x);
+}
+
+
+int
+main()
+{
+  for (auto sch : {minhash<>::one_permutation, minhash<>::derived}) {
+    std::cout << (sch == minhash<>::derived ? "derived" : "one permutation") << '\n';
+    check(sch, 20, 10);
+    check(sch, 1000, 500);
+    check(sch, 5000, 4500);
+    check(sch, 5000, 0);
+  }
+
+  // Densified signatures have no empty bins.
+  minhash<> mh(256);
+  std::vector<int> few {1, 2, 3};
+  for (std::uint32_t v : mh(few.begin(), few.end()))
+    assert(v != 0xffffffffu);
+
+  // Word shingles.
+  std::vector<std::string> s1 {"the", "quick", "brown", "fox", "jumps", "over", "the", "lazy", "dog"};
+  std::vector<std::string> s2 = s1;
+  s2[8] = "cat";
+  double e = similarity(mh.shingles(s1.begin(), s1.end(), 3),
+                        mh.shingles(s2.begin(), s2.end(), 3));
+  std::cout << "shingles: " << e << '\n';
+  assert(e > 0.5 && e < 1);
+  assert(mh.shingles(s1.begin(), s1.begin() + 2, 3) == mh.shingles(s1.begin(), s1.begin() + 2, 5));
+
+  std::cout << "ok\n";
+}
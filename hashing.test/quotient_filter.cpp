@@ -0,0 +1,54 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "quotient_filter.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <map>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  using filter = counting_quotient_filter<>;
+
+  // Two shards with overlapping keys and skewed counts. The filters
+  // start small, so both resize several times.
+  filter a(8, 24, 7), b(10, 22, 7);
+  std::map<int, std::uint64_t> truth;
+  for (int i = 0; i < 50000; ++i) {
+    int k = i % 20000;
+    a.insert(k);
+    ++truth[k];
+  }
+  for (int i = 10000; i < 30000; ++i) {
+    std::uint64_t c = i % 100 == 0 ? 1000000 : 1;
+    b.insert(i, c);
+    truth[i] += c;
+  }
+
+  for (auto const& kc : truth)
+    assert(a.count(kc.first) + b.count(kc.first) >= kc.second);
+
+  filter m = filter::merge(a, b);
+  std::size_t exact = 0;
+  for (auto const& kc : truth) {
+    std::uint64_t c = m.count(kc.first);
+    assert(c >= kc.second);
+    exact += c == kc.second;
+  }
+  std::cout << "quotient bits " << m.quotient_bits()
+            << ", exact counts " << exact << " of " << truth.size() << '\n';
+  assert(exact > truth.size() * 99 / 100);
+
+  int fp = 0;
+  for (int i = 100000; i < 200000; ++i)
+    fp += m.contains(i);
+  std::cout << "false positive rate " << fp / 100000.0 << '\n';
+
+  std::cout << "ok\n";
+}
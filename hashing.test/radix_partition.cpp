@@ -0,0 +1,111 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "radix_partition.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+
+using namespace origin;
+
+
+struct tuple
+{
+  std::uint64_t key;
+  std::uint64_t payload;
+};
+
+
+struct wide
+{
+  std::uint32_t key;
+  char data[20];
+};
+
+
+// Check that every tuple is in the partition given by the high bits of
+// its digest, and that the tuples are a permutation of the input.
+template<typename T, typename K>
+void
+check(partitioned<T> const& r, std::vector<T> const& in, unsigned bits, K key)
+{
+  assert(r.partitions() == std::size_t(1) << bits);
+  assert(r.bounds.front() == 0 && r.bounds.back() == in.size());
+  hash<fnv1a> h;
+  std::vector<int> seen(in.size());
+  for (std::size_t p = 0; p < r.partitions(); ++p)
+    for (std::size_t i = r.bounds[p]; i < r.bounds[p + 1]; ++i) {
+      assert(r.digests[i] == hash_mix(h(key(r.items[i]))));
+      assert(r.digests[i] >> (64 - bits) == p);
+      ++seen[r.items[i].key];
+    }
+  for (int s : seen)
+    assert(s == 1);
+}
+
+
+int
+main()
+{
+  const std::size_t n = 1 << 20;
+  std::vector<tuple> in(n);
+  for (std::size_t i = 0; i < n; ++i)
+    in[i] = {i, i * 3};
+  auto key = [](tuple const& t) { return t.key; };
+
+  // One pass and two passes, sequential and parallel, give the same
+  // result.
+  radix_partitioner<tuple> one(8), two(14), three(14, 3);
+  assert(one.passes().size() == 1);
+  assert(two.passes().size() == 2);
+
+  partitioned<tuple> a = one.partition(in.data(), n, key);
+  check(a, in, 8, key);
+  partitioned<tuple> b = one.partition(in.data(), n, key, 4);
+  assert(a.bounds == b.bounds);
+  for (std::size_t i = 0; i < n; ++i)
+    assert(a.items[i].key == b.items[i].key);
+
+  auto start = std::chrono::steady_clock::now();
+  partitioned<tuple> c = two.partition(in.data(), n, key, 4);
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+  std::cout << "2^14 partitions in 2 passes: " << ns << " ns/tuple\n";
+  check(c, in, 14, key);
+  partitioned<tuple> d = three.partition(in.data(), n, key);
+  assert(c.bounds == d.bounds);
+  for (std::size_t i = 0; i < n; ++i)
+    assert(c.items[i].key == d.items[i].key);
+
+  // Tuples that do not fit a cache line evenly.
+  std::vector<wide> ws(10000);
+  for (std::size_t i = 0; i < ws.size(); ++i)
+    ws[i].key = i;
+  auto wkey = [](wide const& w) { return w.key; };
+  check(radix_partitioner<wide>(6).partition(ws.data(), ws.size(), wkey, 3), ws, 6, wkey);
+
+  // The low-level API, with an unaligned output.
+  radix_partitioner<tuple> p(4);
+  std::vector<std::uint64_t> ds(1000);
+  p.hash_keys(in.data(), 1000, ds.data(), key);
+  std::vector<std::vector<std::size_t>> hists(2, std::vector<std::size_t>(16));
+  radix_partitioner<tuple>::histogram(ds.data(), 500, 60, 4, hists[0].data());
+  radix_partitioner<tuple>::histogram(ds.data() + 500, 500, 60, 4, hists[1].data());
+  std::vector<std::size_t> bounds = radix_partitioner<tuple>::prefix_sum(hists);
+  assert(bounds[16] == 1000);
+  std::vector<tuple> out(1001);
+  std::vector<std::uint64_t> out_ds(1001);
+  radix_partitioner<tuple>::scatter(in.data(), ds.data(), 500, 60, 4, hists[0].data(),
+                                    out.data() + 1, out_ds.data() + 1);
+  radix_partitioner<tuple>::scatter(in.data() + 500, ds.data() + 500, 500, 60, 4, hists[1].data(),
+                                    out.data() + 1, out_ds.data() + 1);
+  for (std::size_t q = 0; q < 16; ++q)
+    for (std::size_t i = bounds[q]; i < bounds[q + 1]; ++i)
+      assert(out_ds[i + 1] >> 60 == q && out_ds[i + 1] == ds[out[i + 1].key]);
+
+  // Empty input.
+  assert(two.partition(in.data(), 0, key, 4).bounds.back() == 0);
+
+  std::cout << "ok\n";
+}
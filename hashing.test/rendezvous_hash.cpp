@@ -0,0 +1,127 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "rendezvous_hash.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+
+
+using namespace origin;
+
+
+// Returns true if each node's share of n keys is within r of its share
+// of the weight.
+template<typename F>
+bool
+balanced(F const& f, std::vector<std::uint64_t> const& nodes,
+         std::vector<double> const& weights, int n, double r)
+{
+  std::map<std::uint64_t, int> count;
+  for (int k = 0; k < n; ++k)
+    ++count[f(k)];
+  double total = 0;
+  for (double w : weights)
+    total += w;
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    double share = double(count[nodes[i]]) / n, expect = weights[i] / total;
+    if (std::abs(share - expect) > r * expect) {
+      std::cout << "node " << nodes[i] << ": " << share << " vs " << expect << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+
+int
+main()
+{
+  // The logarithm approximation.
+  for (std::uint32_t x = 0; x < 0xffff0000u; x += 0x10001u) {
+    double u = double((x >> 8) | 1) / 16777216.0;
+    assert(std::abs(rendezvous_detail::neg_log(x) + std::log(u)) < 2e-6);
+  }
+
+  std::vector<std::uint64_t> nodes;
+  std::vector<double> weights;
+  rendezvous_hash<> h;
+  for (int i = 0; i < 20; ++i) {
+    nodes.push_back(1000 + i);
+    weights.push_back(1 + i % 4);
+    h.insert(nodes.back(), weights.back());
+  }
+  const int n = 200000;
+  assert(balanced(h, nodes, weights, n, 0.1));
+
+  // Removing a node only moves its own keys.
+  rendezvous_hash<> g = h;
+  g.erase(1007);
+  assert(g.size() == 19);
+  int moved = 0;
+  for (int k = 0; k < n; ++k) {
+    std::uint64_t a = h(k), b = g(k);
+    if (a != b) {
+      assert(a == 1007);
+      ++moved;
+    }
+  }
+  std::cout << "moved on erase: " << double(moved) / n << '\n';
+
+  // Raising a weight only moves keys to that node.
+  g = h;
+  g.insert(1003, 8);
+  for (int k = 0; k < n; ++k)
+    assert(h(k) == g(k) || g(k) == 1003);
+
+  // A zero weight receives nothing.
+  g.insert(1003, 0);
+  for (int k = 0; k < 10000; ++k)
+    assert(g(k) != 1003);
+
+  // Every weight zero is rejected.
+  rendezvous_hash<> zero;
+  zero.insert(1, 0);
+  zero.insert(2, 0);
+  try {
+    zero(5);
+    assert(false);
+  } catch (std::logic_error&) { }
+  try {
+    skeleton_rendezvous_hash<>({1, 2}, {0, 0});
+    assert(false);
+  } catch (std::invalid_argument&) { }
+
+  // The skeleton variant, over a large cluster.
+  std::vector<std::uint64_t> many;
+  std::vector<double> mw;
+  rendezvous_hash<> flat;
+  for (int i = 0; i < 1000; ++i) {
+    many.push_back(i);
+    mw.push_back(i % 10 == 0 ? 4 : 1);
+    flat.insert(i, mw.back());
+  }
+  skeleton_rendezvous_hash<> s(many, mw, 8);
+  std::cout << "skeleton depth: " << s.depth() << '\n';
+  assert(s.depth() == 4);
+  assert(balanced(s, many, mw, 2000000, 0.25));
+
+  auto start = std::chrono::steady_clock::now();
+  std::uint64_t sum = 0;
+  for (int k = 0; k < 100000; ++k)
+    sum += flat(k);
+  auto mid = std::chrono::steady_clock::now();
+  for (int k = 0; k < 100000; ++k)
+    sum += s(k);
+  auto stop = std::chrono::steady_clock::now();
+  std::cout << "1000 nodes: flat "
+            << std::chrono::duration<double, std::nano>(mid - start).count() / 100000
+            << " ns/key, skeleton "
+            << std::chrono::duration<double, std::nano>(stop - mid).count() / 100000
+            << " ns/key (" << sum % 2 << ")\n";
+
+  std::cout << "ok\n";
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "sampling.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  const std::size_t n = 1000000;
+  std::vector<std::uint64_t> keys(n);
+  for (std::size_t i = 0; i < n; ++i)
+    keys[i] = i * 7919;
+
+  consistent_sampler<> s1(0.01, 42);
+  consistent_sampler<> s01 = s1.subsample(0.001);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::size_t> a = s1.filter(keys.data(), n);
+  auto stop = std::chrono::steady_clock::now();
+  std::vector<std::size_t> b = s01.filter(keys.data(), n);
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count() / n;
+  std::cout << "1%: " << a.size() << " 0.1%: " << b.size()
+            << " filter: " << ns << " ns/key\n";
+  assert(a.size() > 9000 && a.size() < 11000);
+  assert(b.size() > 800 && b.size() < 1200);
+
+  // The batch filter agrees with the predicate, and samples are nested.
+  for (std::size_t i : a)
+    assert(s1(keys[i]));
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < n; ++i)
+    count += s1(keys[i]);
+  assert(count == a.size());
+  for (std::size_t i : b)
+    assert(std::binary_search(a.begin(), a.end(), i));
+
+  // Independent samplers with the same seed agree; other seeds differ.
+  consistent_sampler<> t1(0.01, 42), u1(0.01, 43);
+  assert(t1.filter(keys.data(), n) == a);
+  assert(u1.filter(keys.data(), n) != a);
+
+  // Extreme rates.
+  assert(consistent_sampler<>(0).filter(keys.data(), n).empty());
+  assert(consistent_sampler<>(1).filter(keys.data(), n).size() == n);
+  assert(consistent_sampler<>(1)(std::string("anything")));
+
+  // Partitions: the first group is the sample with the same rate.
+  consistent_partition<> p({1, 9, 90}, 42);
+  std::size_t sizes[3] = {};
+  for (std::size_t i = 0; i < n; ++i) {
+    std::size_t g = p(keys[i]);
+    assert(g < 3);
+    assert((g == 0) == s1(keys[i]));
+    ++sizes[g];
+  }
+  std::cout << "groups: " << sizes[0] << ' ' << sizes[1] << ' ' << sizes[2] << '\n';
+  assert(sizes[1] > 85000 && sizes[1] < 95000);
+
+  try {
+    s01.subsample(0.5);
+    assert(false);
+  } catch (std::invalid_argument const&) { }
+
+  std::cout << "ok\n";
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "shm_table.hpp"
+
+#include <cassert>
+#include <cerrno>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  using table = shm_table<int, long>;
+
+  // The writer builds an anonymous table and a child process reads it
+  // through an inherited descriptor.
+  table t = table::create_anonymous(1000, 0x5eed);
+  for (int i = 0; i < 1000; ++i)
+    assert(t.insert(i, i * 10L));
+  assert(t.size() == 1000);
+
+  for (int i = 0; i < 1000; i += 2)
+    assert(t.erase(i));
+  assert(t.size() == 500);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    table r = table::open(t.segment().fd());
+    assert(r.seed() == 0x5eed);
+    for (int i = 0; i < 1000; ++i) {
+      long v = 0;
+      bool found = r.find(i, v);
+      if (found != (i % 2 == 1) || (found && v != i * 10L))
+        _exit(1);
+    }
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  // A named table is opened by name in a child process, then unlinked.
+  std::string name = "/origin.shm_table." + std::to_string(getpid());
+  {
+    table w = table::create(name.c_str(), 100, 7);
+    for (int i = 0; i < 100; ++i)
+      assert(w.insert(i, -i));
+    pid = fork();
+    if (pid == 0) {
+      table r = table::open(name.c_str());
+      long v = 0;
+      _exit(r.seed() == 7 && r.size() == 100 && r.find(42, v) && v == -42 ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    table::unlink(name.c_str());
+  }
+  bool threw = false;
+  try { table::open(name.c_str()); } catch (std::system_error&) { threw = true; }
+  assert(threw);
+
+  // A table that cannot be mapped does not leave its name behind.
+  threw = false;
+  try { table::create(name.c_str(), std::size_t(1) << 50, 7); } catch (std::system_error&) { threw = true; }
+  assert(threw);
+  assert(shm_open(name.c_str(), O_RDONLY, 0) < 0 && errno == ENOENT);
+
+  std::cout << "ok\n";
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "simhash.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+
+
+using namespace origin;
+
+
+// Flip d distinct random bits of x.
+std::uint64_t
+flip(std::uint64_t x, int d, std::mt19937_64& rng)
+{
+  std::uint64_t m = 0;
+  while (__builtin_popcountll(m) < d)
+    m |= std::uint64_t(1) << (rng() % 64);
+  return x ^ m;
+}
+
+
+void
+check_index(int k, int m)
+{
+  std::mt19937_64 rng(k * 10 + m);
+  simhash_index idx(k, m);
+  std::vector<std::uint64_t> fps;
+  for (int i = 0; i < 20000; ++i) {
+    fps.push_back(rng());
+    idx.insert(fps.back(), i);
+  }
+  idx.build(4);
+  assert(idx.size() == fps.size());
+
+  for (int i = 0; i < 500; ++i) {
+    for (int d = 0; d <= k + 1; ++d) {
+      std::vector<std::uint64_t> r = idx.query(flip(fps[i], d, rng));
+      bool found = std::binary_search(r.begin(), r.end(), std::uint64_t(i));
+      assert(found == (d <= k));
+      // Random fingerprints are far apart.
+      assert(r.size() <= 1);
+    }
+  }
+  std::cout << "  k=" << k << " tables=" << idx.tables() << " ok\n";
+}
+
+
+int
+main()
+{
+  // Similar documents have close fingerprints.
+  std::vector<std::string> words;
+  for (int i = 0; i < 200; ++i)
+    words.push_back("w" + std::to_string(i));
+  simhash<> a, b, c;
+  a.insert(words.begin(), words.end());
+  b.insert(words.begin() + 2, words.end());
+  for (int i = 0; i < 200; ++i)
+    c.insert("x" + std::to_string(i));
+  std::cout << "near: " << hamming_distance(a.value(), b.value())
+            << " far: " << hamming_distance(a.value(), c.value()) << '\n';
+  assert(hamming_distance(a.value(), b.value()) <= 8);
+  assert(hamming_distance(a.value(), c.value()) >= 16);
+
+  // Weights.
+  simhash<> w;
+  w.insert(std::string("heavy"), 100);
+  w.insert(std::string("light"), 1);
+  simhash<> h;
+  h.insert(std::string("heavy"));
+  assert(w.value() == h.value());
+  w.clear();
+  assert(w.value() == 0);
+
+  for (int k = 0; k <= 3; ++k)
+    check_index(k, 0);
+  check_index(3, 6);
+
+  simhash_index idx(2);
+  idx.insert(1, 1);
+  try {
+    idx.query(1);
+    assert(false);
+  } catch (std::logic_error const&) { }
+
+  std::cout << "ok\n";
+}
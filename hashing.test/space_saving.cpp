@@ -0,0 +1,76 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "space_saving.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <map>
+
+
+using namespace origin;
+
+
+int
+main()
+{
+  // A Zipf-like stream over 10000 keys, interleaved and split across
+  // two shards.
+  std::map<int, std::uint64_t> truth;
+  space_saving<int> a(100), b(100);
+  for (int r = 0; r < 100; ++r) {
+    for (int k = 1; k <= 10000; ++k) {
+      if (r % (k < 100 ? 1 : 100) != 0)
+        continue;
+      std::uint64_t w = k < 100 ? 1000 / k : 1;
+      (k % 2 ? a : b).insert(k, w);
+      truth[k] += w;
+    }
+  }
+
+  auto check = [&truth](space_saving<int> const& s) {
+    for (auto const& i : s.top(s.size())) {
+      assert(i.count - i.error <= truth[i.key]);
+      assert(truth[i.key] <= i.count);
+    }
+  };
+  check(a);
+  check(b);
+
+  a.merge(b);
+  check(a);
+
+  // The heaviest keys are found, in order.
+  auto top = a.top(10);
+  for (int i = 0; i < 10; ++i) {
+    std::cout << top[i].key << ": " << top[i].count << " (+/- " << top[i].error << ")\n";
+    assert(top[i].key == i + 1);
+  }
+
+  // Merging summaries with tied counts, then inserting more. Counts are
+  // exact while the summary has room.
+  space_saving<int> c(8), d(8);
+  for (int k = 0; k < 3; ++k) {
+    c.insert(k, 5);
+    d.insert(k + 3, 5);
+  }
+  c.insert(6, 2);
+  d.insert(7, 2);
+  c.merge(d);
+  assert(c.size() == 8 && c.bucket_count() == 2);
+  for (int r = 0; r < 4; ++r)
+    for (int k = 0; k < 8; k += r + 1)
+      c.insert(k);
+  std::map<int, std::uint64_t> exact = {{0, 9}, {1, 6}, {2, 7}, {3, 7}, {4, 8}, {5, 6}, {6, 5}, {7, 3}};
+  std::vector<space_saving<int>::item> all = c.top(8);
+  assert(all.size() == 8);
+  for (std::size_t i = 0; i < all.size(); ++i) {
+    assert(i == 0 || all[i - 1].count >= all[i].count);
+    assert(all[i].count == exact[all[i].key] && all[i].error == 0);
+  }
+  assert(c.bucket_count() == 6);
+  c.insert(8);
+  assert(c.find(8).count == 4 && c.find(8).error == 3 && c.find(7).count == 0);
+
+  std::cout << "ok\n";
+}
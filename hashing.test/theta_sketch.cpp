@@ -0,0 +1,101 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "theta_sketch.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+
+using namespace origin;
+
+
+// Returns true if e is within r of the true value x.
+bool
+near(double e, double x, double r)
+{
+  return std::abs(e - x) <= r * x;
+}
+
+
+int
+main()
+{
+  // Exact mode.
+  theta_sketch<> small(1024);
+  for (int i = 0; i < 500; ++i) {
+    small.insert(i);
+    small.insert(i);
+  }
+  assert(small.estimate() == 500);
+  assert(small.compact().exact());
+
+  // A = [0, 300000), B = [200000, 500000).
+  std::vector<int> as, bs;
+  for (int i = 0; i < 300000; ++i)
+    as.push_back(i);
+  for (int i = 200000; i < 500000; ++i)
+    bs.push_back(i);
+
+  theta_sketch<> a(4096), b(4096);
+  a.insert(as.begin(), as.end());
+  b.insert(bs.begin(), bs.end(), 4);
+  compact_theta_sketch ca = a.compact(), cb = b.compact();
+  assert(ca.entries.size() == 4096);
+  assert(std::is_sorted(ca.entries.begin(), ca.entries.end()));
+
+  double u = theta_union(ca, cb, 4096).estimate();
+  double i = theta_intersection(ca, cb).estimate();
+  double d = theta_difference(ca, cb).estimate();
+  std::cout << "A: " << ca.estimate() << " B: " << cb.estimate()
+            << " A|B: " << u << " A&B: " << i << " A-B: " << d << std::endl;
+  assert(near(ca.estimate(), 300000, 0.05));
+  assert(near(cb.estimate(), 300000, 0.05));
+  assert(near(u, 500000, 0.05));
+  assert(near(i, 100000, 0.15));
+  assert(near(d, 200000, 0.1));
+
+  // Parallel and sequential updates agree.
+  theta_sketch<> p(4096);
+  p.insert(as.begin(), as.end(), 8);
+  assert(p.compact().entries == ca.entries);
+
+  // Merging update sketches is the same as a union.
+  theta_sketch<> m = a;
+  m.merge(b);
+  assert(m.compact().entries == theta_union(ca, cb, 4096).entries);
+
+  // Parallel union of many sketches.
+  std::vector<compact_theta_sketch> parts;
+  for (int s = 0; s < 10; ++s) {
+    theta_sketch<> t(1024);
+    for (int j = s * 10000; j < (s + 2) * 10000; ++j)
+      t.insert(j);
+    parts.push_back(t.compact());
+  }
+  compact_theta_sketch all = theta_union(parts, 1024, 4);
+  assert(all.entries == theta_union(parts, 1024, 1).entries);
+  std::cout << "union of parts: " << all.estimate() << '\n';
+  assert(near(all.estimate(), 110000, 0.1));
+
+  // Serialization.
+  std::vector<byte> bytes = ca.serialize();
+  std::cout << "serialized: " << bytes.size() << " bytes\n";
+  assert(bytes.size() < 4096 * 8);
+  compact_theta_sketch r = compact_theta_sketch::deserialize(bytes.data(), bytes.size());
+  assert(r.theta == ca.theta && r.entries == ca.entries && r.seed == ca.seed);
+  try {
+    compact_theta_sketch::deserialize(bytes.data(), bytes.size() / 2);
+    assert(false);
+  } catch (std::runtime_error const&) { }
+
+  // Seeds must match.
+  theta_sketch<> other(4096, 1);
+  try {
+    theta_union(ca, other.compact(), 4096);
+    assert(false);
+  } catch (std::invalid_argument const&) { }
+
+  std::cout << "ok\n";
+}
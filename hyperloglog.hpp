@@ -0,0 +1,440 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_HYPERLOGLOG_HPP
+#define ORIGIN_HYPERLOGLOG_HPP
+
+// A HyperLogLog++ distinct counter [1] fed by 64-bit digests.
+//
+// At low cardinalities the sketch is sparse: it keeps a sorted list of
+// (index, rank) pairs at a higher precision p' = 25, and estimates with
+// linear counting. New pairs are buffered and merged into the list in
+// batches. When the list would be larger than the dense registers, the
+// sketch converts to the dense representation.
+//
+// The dense representation packs ten 6-bit registers into each 64-bit
+// word. Two dense sketches are merged with a lane-wise maximum computed
+// on whole words (SIMD within a register), which the compiler can also
+// vectorize across words.
+//
+// Estimates for the dense representation use the improved estimator
+// of [2], which is accurate over the whole range of cardinalities
+// without the empirical bias-correction tables of [1].
+//
+// Sketches are not synchronized. For parallel counting, give each
+// thread its own sketch and merge them when done.
+//
+// [1] S. Heule et al. HyperLogLog in practice: algorithmic engineering
+// of a state of the art cardinality estimation algorithm. EDBT 2013.
+//
+// [2] O. Ertl. New cardinality estimation algorithms for HyperLogLog
+// sketches. arXiv:1702.01284, 2017.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+// -------------------------------------------------------------------------- //
+// Packed registers
+
+// A sequence of 6-bit registers, ten to a 64-bit word.
+struct hll_registers
+{
+  static constexpr unsigned width = 6;
+  static constexpr unsigned per_word = 10;
+  static constexpr std::uint64_t lane = (1u << width) - 1;
+
+  // The low and high bits of every lane.
+  static constexpr std::uint64_t lows = 0x0041041041041041ull;
+  static constexpr std::uint64_t highs = lows << (width - 1);
+  static constexpr std::uint64_t lanes = 0x0fffffffffffffffull;
+
+  hll_registers() = default;
+
+  explicit hll_registers(std::size_t n)
+    : words((n + per_word - 1) / per_word)
+  { }
+
+  unsigned get(std::size_t i) const
+  {
+    return (words[i / per_word] >> (i % per_word * width)) & lane;
+  }
+
+  void set(std::size_t i, unsigned v)
+  {
+    std::uint64_t& w = words[i / per_word];
+    unsigned s = i % per_word * width;
+    w = (w & ~(lane << s)) | (std::uint64_t(v) << s);
+  }
+
+  // Set register i to the max of its value and v.
+  void update(std::size_t i, unsigned v)
+  {
+    if (v > get(i))
+      set(i, v);
+  }
+
+  // Returns the lane-wise maximum of two words.
+  static std::uint64_t max(std::uint64_t a, std::uint64_t b)
+  {
+    // Compare the low bits of each lane with the high bit as a borrow
+    // guard, then fold in the high bits.
+    std::uint64_t d = (a | highs) - (b & ~highs);
+    std::uint64_t ge = ((a & ~b) | (~(a ^ b) & d)) & highs;
+    std::uint64_t m = (ge << 1) - (ge >> (width - 1));
+    return ((a & m) | (b & ~m)) & lanes;
+  }
+
+  void merge(hll_registers const& x)
+  {
+    for (std::size_t i = 0; i < words.size(); ++i)
+      words[i] = max(words[i], x.words[i]);
+  }
+
+  std::vector<std::uint64_t> words;
+};
+
+
+// -------------------------------------------------------------------------- //
+// HyperLogLog
+
+template<Hash_algorithm_64 H = fnv1a>
+class hyperloglog
+{
+  static constexpr unsigned sparse_precision = 25;
+  static constexpr byte format_version = 2;
+
+public:
+  // Create a sketch with 2^p registers, 4 <= p <= 18. The relative
+  // standard error is about 1.04 / sqrt(2^p).
+  explicit hyperloglog(unsigned p = 14, std::uint64_t seed = 0)
+    : p_(p), seed_(seed), hash_(H(seed))
+  {
+    if (p < 4 || p > 18)
+      throw std::invalid_argument("hyperloglog: precision out of range");
+  }
+
+  template<Hashable_with<H> T>
+  void insert(T const& t)
+  {
+    insert_digest(hash_mix(hash_(t)));
+  }
+
+  void insert_digest(std::uint64_t x)
+  {
+    if (dense_) {
+      std::size_t i = x >> (64 - p_);
+      regs_.update(i, rank(x << p_, 64 - p_));
+      return;
+    }
+    buffer_.push_back(encode(x));
+    if (buffer_.size() >= buffer_limit())
+      flush();
+  }
+
+  // Returns the estimated number of distinct objects inserted.
+  double estimate() const
+  {
+    if (!dense_) {
+      flush();
+      if (!dense_)
+        return linear_counting(std::size_t(1) << sparse_precision, sparse_.size());
+    }
+    return dense_estimate();
+  }
+
+  // Add the objects of another sketch with the same precision and seed.
+  void merge(hyperloglog const& x)
+  {
+    if (x.p_ != p_)
+      throw std::invalid_argument("hyperloglog: precision mismatch");
+    if (x.seed_ != seed_)
+      throw std::invalid_argument("hyperloglog: seed mismatch");
+    x.flush();
+    if (!x.dense_) {
+      if (!dense_) {
+        buffer_.insert(buffer_.end(), x.sparse_.begin(), x.sparse_.end());
+        flush();
+        return;
+      }
+      for (std::uint32_t e : x.sparse_) {
+        std::size_t i;
+        unsigned r;
+        decode(e, i, r);
+        regs_.update(i, r);
+      }
+      return;
+    }
+    densify();
+    regs_.merge(x.regs_);
+  }
+
+  bool is_sparse() const { return !dense_; }
+  unsigned precision() const { return p_; }
+  std::uint64_t seed() const { return seed_; }
+
+  // Serialization format:
+  //
+  //    u8 version, u8 precision, u8 dense, u64 seed (little-endian)
+  //    sparse: varint count, then varint deltas of the sorted pairs
+  //    dense: the register words, little-endian
+  std::vector<byte> serialize() const
+  {
+    flush();
+    std::vector<byte> out {format_version, byte(p_), byte(dense_)};
+    put_word(out, seed_);
+    if (dense_) {
+      for (std::uint64_t w : regs_.words)
+        put_word(out, w);
+    } else {
+      put_varint(out, sparse_.size());
+      std::uint32_t prev = 0;
+      for (std::uint32_t e : sparse_) {
+        put_varint(out, e - prev);
+        prev = e;
+      }
+    }
+    return out;
+  }
+
+  // Read a sketch written by serialize(). Throws if it was made with a
+  // different seed.
+  static hyperloglog deserialize(byte const* p, std::size_t n, std::uint64_t seed = 0)
+  {
+    byte const* end = p + n;
+    if (n < 11 || p[0] != format_version)
+      throw std::runtime_error("hyperloglog: bad serialization");
+    hyperloglog h(p[1], seed);
+    bool dense = p[2];
+    p += 3;
+    if (get_word(p) != seed)
+      throw std::runtime_error("hyperloglog: seed mismatch");
+    if (dense) {
+      h.dense_ = true;
+      h.regs_ = hll_registers(std::size_t(1) << h.p_);
+      if (std::size_t(end - p) < 8 * h.regs_.words.size())
+        throw std::runtime_error("hyperloglog: truncated serialization");
+      for (std::uint64_t& w : h.regs_.words)
+        w = get_word(p);
+    } else {
+      // Pairs must have strictly increasing indices.
+      std::uint64_t count = get_varint(p, end);
+      std::uint64_t prev = 0;
+      for (std::uint64_t i = 0; i < count; ++i) {
+        std::uint64_t e = prev + get_varint(p, end);
+        if (e > std::numeric_limits<std::uint32_t>::max() ||
+            (i && sparse_index(e) <= sparse_index(prev)))
+          throw std::runtime_error("hyperloglog: bad serialization");
+        h.sparse_.push_back(e);
+        prev = e;
+      }
+    }
+    return h;
+  }
+
+private:
+  // Returns the 1-based position of the first 1 bit among the leading
+  // bits of w, or bits + 1 if there is none.
+  static unsigned rank(std::uint64_t w, unsigned bits)
+  {
+    unsigned r = w ? __builtin_clzll(w) + 1 : bits + 1;
+    return std::min(r, bits + 1);
+  }
+
+  // Encode a digest as a sparse pair: the index in the high 25 bits,
+  // then the rank and a flag. If the bits of the index past p are zero,
+  // the rank must be stored; otherwise it can be recovered from the
+  // index. Encoded pairs are ordered by index.
+  std::uint32_t encode(std::uint64_t x) const
+  {
+    constexpr unsigned sp = sparse_precision;
+    std::uint32_t idx = x >> (64 - sp);
+    std::uint32_t low = idx & ((1u << (sp - p_)) - 1);
+    if (low == 0)
+      return (idx << 7) | (rank(x << sp, 64 - sp) << 1) | 1;
+    return idx << 7;
+  }
+
+  static std::uint32_t sparse_index(std::uint32_t e)
+  {
+    return e >> 7;
+  }
+
+  // Returns the dense register and rank of a sparse pair.
+  void decode(std::uint32_t e, std::size_t& i, unsigned& r) const
+  {
+    constexpr unsigned sp = sparse_precision;
+    std::uint32_t idx = sparse_index(e);
+    i = idx >> (sp - p_);
+    if (e & 1) {
+      r = ((e >> 1) & 63) + (sp - p_);
+    } else {
+      std::uint64_t w = std::uint64_t(idx) << (64 - (sp - p_));
+      r = rank(w, sp - p_);
+    }
+  }
+
+  // The sorted list grows in batches.
+  std::size_t buffer_limit() const
+  {
+    return std::max<std::size_t>(256, sparse_.size() / 4);
+  }
+
+  // Merge the buffered pairs into the sorted list, keeping one pair per
+  // index: the one with the largest rank.
+  void flush() const
+  {
+    if (buffer_.empty())
+      return;
+    std::sort(buffer_.begin(), buffer_.end());
+    std::vector<std::uint32_t> out;
+    out.reserve(sparse_.size() + buffer_.size());
+    std::merge(sparse_.begin(), sparse_.end(), buffer_.begin(), buffer_.end(),
+               std::back_inserter(out),
+               [](std::uint32_t a, std::uint32_t b) {
+                 return sparse_index(a) < sparse_index(b);
+               });
+    std::size_t n = 0;
+    for (std::uint32_t e : out) {
+      if (n && sparse_index(out[n - 1]) == sparse_index(e)) {
+        std::size_t i;
+        unsigned r1, r2;
+        decode(out[n - 1], i, r1);
+        decode(e, i, r2);
+        if (r2 > r1)
+          out[n - 1] = e;
+      } else {
+        out[n++] = e;
+      }
+    }
+    out.resize(n);
+    sparse_.swap(out);
+    buffer_.clear();
+
+    // Four bytes per pair against 6 bits per register.
+    if (sparse_.size() * 4 * 8 > (std::size_t(6) << p_))
+      densify();
+  }
+
+  void densify() const
+  {
+    if (dense_)
+      return;
+    flush();
+    regs_ = hll_registers(std::size_t(1) << p_);
+    for (std::uint32_t e : sparse_) {
+      std::size_t i;
+      unsigned r;
+      decode(e, i, r);
+      regs_.update(i, r);
+    }
+    sparse_.clear();
+    sparse_.shrink_to_fit();
+    dense_ = true;
+  }
+
+  static double linear_counting(std::size_t m, std::size_t n)
+  {
+    return m * std::log(double(m) / (m - n));
+  }
+
+  static double sigma(double x)
+  {
+    if (x == 1)
+      return std::numeric_limits<double>::infinity();
+    double y = 1, z = x, prev;
+    do {
+      x *= x;
+      prev = z;
+      z += x * y;
+      y += y;
+    } while (z != prev);
+    return z;
+  }
+
+  static double tau(double x)
+  {
+    if (x == 0 || x == 1)
+      return 0;
+    double y = 1, z = 1 - x, prev;
+    do {
+      x = std::sqrt(x);
+      prev = z;
+      y *= 0.5;
+      z -= (1 - x) * (1 - x) * y;
+    } while (z != prev);
+    return z / 3;
+  }
+
+  double dense_estimate() const
+  {
+    std::size_t m = std::size_t(1) << p_;
+    unsigned q = 64 - p_;
+    std::vector<std::size_t> c(q + 2);
+    for (std::size_t i = 0; i < m; ++i)
+      ++c[regs_.get(i)];
+    double z = m * tau(1 - double(c[q + 1]) / m);
+    for (unsigned k = q; k >= 1; --k)
+      z = 0.5 * (z + c[k]);
+    z += m * sigma(double(c[0]) / m);
+    return m / (2 * std::log(2.0)) * m / z;
+  }
+
+  static void put_word(std::vector<byte>& out, std::uint64_t w)
+  {
+    for (unsigned i = 0; i < 8; ++i)
+      out.push_back(byte(w >> (8 * i)));
+  }
+
+  // Read a little-endian word. The caller checks the length.
+  static std::uint64_t get_word(byte const*& p)
+  {
+    std::uint64_t w = 0;
+    for (unsigned i = 0; i < 8; ++i)
+      w |= std::uint64_t(*p++) << (8 * i);
+    return w;
+  }
+
+  static void put_varint(std::vector<byte>& out, std::uint64_t x)
+  {
+    for (; x >= 0x80; x >>= 7)
+      out.push_back(byte(x | 0x80));
+    out.push_back(byte(x));
+  }
+
+  static std::uint64_t get_varint(byte const*& p, byte const* end)
+  {
+    std::uint64_t x = 0;
+    for (unsigned s = 0; p != end && s < 64; s += 7) {
+      byte b = *p++;
+      x |= std::uint64_t(b & 0x7f) << s;
+      if (!(b & 0x80))
+        return x;
+    }
+    throw std::runtime_error("hyperloglog: truncated serialization");
+  }
+
+  unsigned p_;
+  std::uint64_t seed_;
+  hash<H> hash_;
+
+  // Buffered pairs are merged lazily, including by const observers.
+  mutable bool dense_ = false;
+  mutable std::vector<std::uint32_t> sparse_;
+  mutable std::vector<std::uint32_t> buffer_;
+  mutable hll_registers regs_;
+};
+
+
+} // namespace origin
+
+
+#endif
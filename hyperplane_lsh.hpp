@@ -0,0 +1,186 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_HYPERPLANE_LSH_HPP
+#define ORIGIN_HYPERPLANE_LSH_HPP
+
+// Sign-random-projection LSH [1] for approximate nearest neighbors of
+// float vectors under angular (cosine) distance.
+//
+// Each bit of a signature is the sign of the dot product of the vector
+// with a random hyperplane. Two vectors at angle theta agree on a bit
+// with probability 1 - theta / pi. The index keeps L tables, each keyed
+// by a K-bit signature, and a query returns the vectors that share a
+// bucket with it in any table.
+//
+// The hyperplanes are not stored as a matrix of floats. Their
+// coefficients are random signs [2], generated 64 at a time from the
+// hash algorithm H applied to (table, bit, block) under the seed. The
+// index keeps those sign words, one bit per coefficient, and any index
+// with the same seed and dimensions has the same hyperplanes.
+//
+// Dot products accumulate into 64 independent lanes, one per sign bit,
+// so that the compiler vectorizes them on targets with per-lane shifts
+// (e.g., AVX2).
+//
+// [1] M. Charikar. Similarity estimation techniques from rounding
+// algorithms. STOC 2002.
+//
+// [2] D. Achlioptas. Database-friendly random projections: Johnson-
+// Lindenstrauss with binary coins. J. Comput. Syst. Sci. 66(4), 2003.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+
+namespace origin
+{
+
+template<Hash_algorithm_64 H = fnv1a>
+class hyperplane_lsh
+{
+  using table = std::unordered_map<std::uint64_t, std::vector<std::uint64_t>>;
+
+public:
+  // Create an index for vectors of dimension dim with the given number
+  // of tables, each keyed by bits <= 64 hyperplanes.
+  hyperplane_lsh(std::size_t dim, std::size_t bits, std::size_t tables,
+                 std::uint64_t seed = 0)
+    : dim_(dim), bits_(bits), blocks_((dim + 63) / 64), tables_(tables)
+  {
+    if (dim == 0 || bits == 0 || bits > 64 || tables == 0)
+      throw std::invalid_argument("hyperplane_lsh: bad dimensions");
+    H proto(seed);
+    signs_.resize(tables * bits * blocks_);
+    std::uint64_t* p = signs_.data();
+    for (std::uint64_t t = 0; t < tables; ++t)
+      for (std::uint64_t b = 0; b < bits; ++b)
+        for (std::uint64_t k = 0; k < blocks_; ++k) {
+          H h = proto;
+          hash_append(h, t, b, k);
+          *p++ = hash_mix(h.value());
+        }
+  }
+
+  // Returns the signature of x in table t.
+  std::uint64_t signature(float const* x, std::size_t t) const
+  {
+    std::uint64_t sig = 0;
+    for (std::size_t b = 0; b < bits_; ++b)
+      sig |= std::uint64_t(dot(x, plane(t, b)) >= 0) << b;
+    return sig;
+  }
+
+  // Add the vector x with the given id.
+  void insert(std::uint64_t id, float const* x)
+  {
+    for (std::size_t t = 0; t < tables_.size(); ++t)
+      tables_[t][signature(x, t)].push_back(id);
+    ++size_;
+  }
+
+  // Add n vectors stored contiguously in xs, where the vector at
+  // xs + i * dim has id ids[i]. Signatures are computed in parallel
+  // over the vectors, then the tables are filled in parallel, with each
+  // thread owning a disjoint set of tables.
+  void insert(std::uint64_t const* ids, float const* xs, std::size_t n,
+              unsigned threads = 1)
+  {
+    threads = std::max(1u, threads);
+    std::size_t l = tables_.size();
+    std::vector<std::uint64_t> sigs(n * l);
+
+    std::vector<std::thread> ts;
+    std::size_t chunk = (n + threads - 1) / threads;
+    for (std::size_t lo = 0; lo < n; lo += chunk)
+      ts.emplace_back([&, lo] {
+        for (std::size_t i = lo; i < std::min(n, lo + chunk); ++i)
+          for (std::size_t t = 0; t < l; ++t)
+            sigs[i * l + t] = signature(xs + i * dim_, t);
+      });
+    for (std::thread& t : ts)
+      t.join();
+
+    ts.clear();
+    for (unsigned w = 0; w < std::min<std::size_t>(threads, l); ++w)
+      ts.emplace_back([&, w] {
+        for (std::size_t t = w; t < l; t += threads)
+          for (std::size_t i = 0; i < n; ++i)
+            tables_[t][sigs[i * l + t]].push_back(ids[i]);
+      });
+    for (std::thread& t : ts)
+      t.join();
+    size_ += n;
+  }
+
+  // Returns the ids of the vectors sharing a bucket with x in some
+  // table, in increasing order and without duplicates.
+  std::vector<std::uint64_t> query(float const* x) const
+  {
+    std::vector<std::uint64_t> out;
+    for (std::size_t t = 0; t < tables_.size(); ++t) {
+      auto iter = tables_[t].find(signature(x, t));
+      if (iter != tables_[t].end())
+        out.insert(out.end(), iter->second.begin(), iter->second.end());
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+  }
+
+  void clear()
+  {
+    for (table& t : tables_)
+      t.clear();
+    size_ = 0;
+  }
+
+  std::size_t dimension() const { return dim_; }
+  std::size_t bits() const { return bits_; }
+  std::size_t tables() const { return tables_.size(); }
+  std::size_t size() const { return size_; }
+
+private:
+  std::uint64_t const* plane(std::size_t t, std::size_t b) const
+  {
+    return signs_.data() + (t * bits_ + b) * blocks_;
+  }
+
+  // Returns the dot product of x with the hyperplane whose coefficient
+  // i is +1 if bit i of the sign words is set, and -1 otherwise.
+  float dot(float const* x, std::uint64_t const* signs) const
+  {
+    float acc[64] = {};
+    std::size_t i = 0;
+    for (; i + 64 <= dim_; i += 64) {
+      std::uint64_t s = signs[i / 64];
+      float const* y = x + i;
+      for (std::size_t k = 0; k < 64; ++k)
+        acc[k] += ((s >> k) & 1) ? y[k] : -y[k];
+    }
+    float sum = 0;
+    for (std::size_t k = 0; k < 64; ++k)
+      sum += acc[k];
+    if (i < dim_)
+      for (std::uint64_t s = signs[i / 64]; i < dim_; ++i, s >>= 1)
+        sum += (s & 1) ? x[i] : -x[i];
+    return sum;
+  }
+
+  std::size_t dim_;
+  std::size_t bits_;
+  std::size_t blocks_;
+  std::vector<std::uint64_t> signs_;
+  std::vector<table> tables_;
+  std::size_t size_ = 0;
+};
+
+
+} // namespace origin
+
+
+#endif
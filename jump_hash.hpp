@@ -0,0 +1,127 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_JUMP_HASH_HPP
+#define ORIGIN_JUMP_HASH_HPP
+
+// Jump consistent hash [1], which assigns keys to n buckets so that
+// when n grows to n + 1, only 1/(n + 1) of the keys move, and all of
+// them move to the new bucket. It uses no memory and runs in O(log n)
+// expected time, but buckets can only be added or removed at the end.
+//
+// Keys are hashed with origin::hash<H> and the mixed digest drives the
+// jump. The bulk assignment runs a block of keys through the jump loop
+// in lockstep, with branch-free updates, so that the iterations for
+// different keys overlap instead of each key waiting on the previous
+// key's unpredictable loop exit.
+//
+// [1] J. Lamping and E. Veach. A fast, minimal memory, consistent hash
+// algorithm. arXiv:1406.2294, 2014.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+// Returns the bucket in [0, n) for a 64-bit key.
+inline std::int32_t
+jump_consistent_hash(std::uint64_t key, std::int32_t n)
+{
+  std::int64_t b = -1, j = 0;
+  while (j < n) {
+    b = j;
+    key = key * 2862933555777941757ull + 1;
+    j = (b + 1) * (double(std::int64_t(1) << 31) / double((key >> 33) + 1));
+  }
+  return b;
+}
+
+
+template<Hash_algorithm_64 H = fnv1a>
+class jump_hash
+{
+  static constexpr std::size_t lanes = 8;
+
+public:
+  explicit jump_hash(std::int32_t buckets, std::uint64_t seed = 0)
+    : buckets_(buckets), hash_(H(seed))
+  {
+    if (buckets <= 0)
+      throw std::invalid_argument("jump_hash: bad bucket count");
+  }
+
+  // Returns the bucket of a key.
+  template<Hashable_with<H> T>
+  std::int32_t operator()(T const& t) const
+  {
+    return jump_consistent_hash(hash_mix(hash_(t)), buckets_);
+  }
+
+  // Write the buckets of keys[0, n) to out.
+  template<Hashable_with<H> T>
+  void assign(T const* keys, std::size_t n, std::int32_t* out) const
+  {
+    constexpr std::size_t block = 256;
+    std::uint64_t ds[block];
+    for (std::size_t lo = 0; lo < n; lo += block) {
+      std::size_t k = std::min(block, n - lo);
+      for (std::size_t i = 0; i < k; ++i)
+        ds[i] = hash_mix(hash_(keys[lo + i]));
+      assign_digests(ds, k, out + lo);
+    }
+  }
+
+  // Write the buckets of the digests ds[0, n) to out.
+  void assign_digests(std::uint64_t const* ds, std::size_t n, std::int32_t* out) const
+  {
+    std::size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+      std::uint64_t key[lanes];
+      std::int64_t b[lanes], j[lanes];
+      for (std::size_t l = 0; l < lanes; ++l) {
+        key[l] = ds[i + l];
+        b[l] = -1;
+        j[l] = 0;
+      }
+      bool active = true;
+      while (active) {
+        active = false;
+        for (std::size_t l = 0; l < lanes; ++l) {
+          bool a = j[l] < buckets_;
+          b[l] = a ? j[l] : b[l];
+          key[l] = a ? key[l] * 2862933555777941757ull + 1 : key[l];
+          std::int64_t next = (b[l] + 1) * (double(std::int64_t(1) << 31) / double((key[l] >> 33) + 1));
+          j[l] = a ? next : j[l];
+          active |= a;
+        }
+      }
+      for (std::size_t l = 0; l < lanes; ++l)
+        out[i + l] = b[l];
+    }
+    for (; i < n; ++i)
+      out[i] = jump_consistent_hash(ds[i], buckets_);
+  }
+
+  void resize(std::int32_t buckets)
+  {
+    if (buckets <= 0)
+      throw std::invalid_argument("jump_hash: bad bucket count");
+    buckets_ = buckets;
+  }
+
+  std::int32_t buckets() const { return buckets_; }
+
+private:
+  std::int32_t buckets_;
+  hash<H> hash_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,189 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "log_store.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <system_error>
+#include <utility>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace origin
+{
+
+namespace
+{
+
+[[noreturn]] void
+throw_errno(char const* what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace
+
+
+log_file::log_file(log_file&& x) noexcept
+  : fd_(x.fd_), size_(x.size_)
+{
+  x.fd_ = -1;
+  x.size_ = 0;
+}
+
+
+log_file&
+log_file::operator=(log_file&& x) noexcept
+{
+  std::swap(fd_, x.fd_);
+  std::swap(size_, x.size_);
+  return *this;
+}
+
+
+log_file::~log_file()
+{
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+
+// A file that is not created is opened read-only. If it does not
+// exist, the result is a closed file.
+log_file::log_file(std::string const& path, bool create)
+{
+  if (create)
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  else
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    if (!create && errno == ENOENT)
+      return;
+    throw_errno("open");
+  }
+  struct stat st;
+  if (::fstat(fd_, &st) < 0)
+    throw_errno("fstat");
+  size_ = st.st_size;
+}
+
+
+std::uint64_t
+log_file::append(void const* p, std::size_t n)
+{
+  std::uint64_t off = size_;
+  char const* buf = static_cast<char const*>(p);
+  while (n) {
+    ssize_t k = ::write(fd_, buf, n);
+    if (k < 0) {
+      if (errno == EINTR)
+        continue;
+      throw_errno("write");
+    }
+    buf += k;
+    n -= k;
+    size_ += k;
+  }
+  return off;
+}
+
+
+bool
+log_file::read_at(std::uint64_t off, void* p, std::size_t n) const
+{
+  char* buf = static_cast<char*>(p);
+  while (n) {
+    ssize_t k = ::pread(fd_, buf, n, off);
+    if (k < 0) {
+      if (errno == EINTR)
+        continue;
+      throw_errno("pread");
+    }
+    if (k == 0)
+      return false;
+    buf += k;
+    off += k;
+    n -= k;
+  }
+  return true;
+}
+
+
+void
+log_file::sync()
+{
+  if (::fdatasync(fd_) < 0)
+    throw_errno("fdatasync");
+}
+
+
+// Segments are named by a 10-digit id and the extension "data".
+std::vector<std::uint32_t>
+list_log_segments(std::string const& dir)
+{
+  DIR* d = ::opendir(dir.c_str());
+  if (!d)
+    throw_errno("opendir");
+  std::vector<std::uint32_t> ids;
+  while (dirent* e = ::readdir(d)) {
+    unsigned long id;
+    char ext[6];
+    int n = 0;
+    if (std::sscanf(e->d_name, "%10lu.%5s%n", &id, ext, &n) == 2 &&
+        e->d_name[n] == '\0' && std::string(ext) == "data")
+      ids.push_back(id);
+  }
+  ::closedir(d);
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+
+std::string
+log_segment_path(std::string const& dir, std::uint32_t id, char const* ext)
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "/%010u.", id);
+  return dir + name + ext;
+}
+
+
+void
+remove_log_file(std::string const& path)
+{
+  if (::unlink(path.c_str()) < 0 && errno != ENOENT)
+    throw_errno("unlink");
+}
+
+
+void
+rename_log_file(std::string const& from, std::string const& to)
+{
+  if (::rename(from.c_str(), to.c_str()) < 0)
+    throw_errno("rename");
+}
+
+
+void
+sync_log_dir(std::string const& dir)
+{
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    throw_errno("open");
+  int r = ::fsync(fd);
+  int e = errno;
+  ::close(fd);
+  if (r < 0) {
+    errno = e;
+    throw_errno("fsync");
+  }
+}
+
+
+} // namespace origin
@@ -0,0 +1,509 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_LOG_STORE_HPP
+#define ORIGIN_LOG_STORE_HPP
+
+// A log-structured key-value store in the style of Bitcask. Values are
+// appended to segment files in a directory, and an in-memory hash index
+// maps each key to the location of its latest value. Writes are
+// sequential, and a read is a single positioned read.
+//
+// Every record carries a sequence number so that the index can be
+// rebuilt from the segments in any order. Compaction rewrites the live
+// records of all immutable segments into new segments, each with a
+// hint file. At startup, a segment that has a hint file is indexed
+// from the hint alone, without reading its values.
+//
+// Record format (native byte order):
+//
+//    u64 checksum    // of the remaining bytes of the record
+//    u64 sequence
+//    u32 key length
+//    u32 value length (tombstone if all ones)
+//    key, value
+//
+// Hint format:
+//
+//    u64 sequence
+//    u32 key length
+//    u32 value length
+//    u64 record offset
+//    key
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+
+namespace origin
+{
+
+// -------------------------------------------------------------------------- //
+// Log files
+
+// An append-only file with positioned reads.
+class log_file
+{
+public:
+  log_file() = default;
+  log_file(log_file&&) noexcept;
+  log_file& operator=(log_file&&) noexcept;
+  ~log_file();
+
+  // Open the file at path, creating it if requested. The write position
+  // is at the end of the file.
+  log_file(std::string const& path, bool create);
+
+  // Append n bytes, returning the offset at which they were written.
+  std::uint64_t append(void const* p, std::size_t n);
+
+  // Read exactly n bytes at offset. Returns false on a short read.
+  bool read_at(std::uint64_t off, void* p, std::size_t n) const;
+
+  void sync();
+
+  std::uint64_t size() const { return size_; }
+  explicit operator bool() const { return fd_ >= 0; }
+
+private:
+  int fd_ = -1;
+  std::uint64_t size_ = 0;
+};
+
+
+// Returns the ids of the segments in dir, in increasing order.
+std::vector<std::uint32_t> list_log_segments(std::string const& dir);
+
+// Returns the path of segment id with the given extension.
+std::string log_segment_path(std::string const& dir, std::uint32_t id, char const* ext);
+
+// Remove the file at path, ignoring missing files.
+void remove_log_file(std::string const& path);
+
+// Rename a file, replacing the target.
+void rename_log_file(std::string const& from, std::string const& to);
+
+// Flush the entries of a directory to stable storage.
+void sync_log_dir(std::string const& dir);
+
+
+// -------------------------------------------------------------------------- //
+// Log store
+
+template<Hash_algorithm_64 H = fnv1a>
+class log_store
+{
+  static constexpr std::uint32_t tombstone = 0xffffffff;
+  static constexpr std::size_t record_header = 24;
+  static constexpr std::size_t hint_header = 24;
+
+  // The location of a record.
+  struct location
+  {
+    std::uint32_t file;
+    std::uint32_t len;
+    std::uint64_t offset;
+    std::uint64_t seq;
+  };
+
+  using index_type = std::unordered_map<std::string, location, hash<H>>;
+
+public:
+  struct options
+  {
+    // Roll over to a new segment when the active one exceeds this size.
+    std::uint64_t max_segment_size = 64u << 20;
+
+    // Flush each write to stable storage.
+    bool sync = false;
+  };
+
+  explicit log_store(std::string const& dir)
+    : log_store(dir, options())
+  { }
+
+  log_store(std::string const& dir, options opts)
+    : dir_(dir), opts_(opts)
+  {
+    recover();
+    roll();
+  }
+
+  ~log_store()
+  {
+    if (compaction_.valid())
+      compaction_.wait();
+  }
+
+  // Associate the value v with the key k.
+  void put(std::string const& k, std::string const& v)
+  {
+    if (v.size() >= tombstone)
+      throw std::length_error("log_store: value too large");
+    std::lock_guard<std::mutex> lock(mutex_);
+    location loc = write(k, v.data(), v.size());
+    index_[k] = loc;
+  }
+
+  // Copy the value of k into v. Returns false if k is not present.
+  bool get(std::string const& k, std::string& v) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = index_.find(k);
+    if (iter == index_.end())
+      return false;
+    location const& loc = iter->second;
+    v.resize(loc.len);
+    std::uint64_t off = loc.offset + record_header + k.size();
+    if (!files_.at(loc.file).read_at(off, &v[0], loc.len))
+      throw std::runtime_error("log_store: truncated segment");
+    return true;
+  }
+
+  // Remove the key k. Returns false if k was not present.
+  bool erase(std::string const& k)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = index_.find(k);
+    if (iter == index_.end())
+      return false;
+    write(k, nullptr, tombstone);
+    index_.erase(iter);
+    return true;
+  }
+
+  std::size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+  }
+
+  // Rewrite the live records of all immutable segments into new
+  // segments and remove the old ones. Reads and writes may proceed
+  // concurrently.
+  void compact()
+  {
+    std::lock_guard<std::mutex> running(compacting_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    roll();
+    std::vector<std::uint32_t> inputs;
+    for (auto const& f : files_)
+      if (f.first != active_)
+        inputs.push_back(f.first);
+    lock.unlock();
+
+    compactor c(*this);
+    for (std::uint32_t id : inputs)
+      c.copy(id);
+    c.finish();
+
+    // A crash while the inputs are removed must not bring back a deleted
+    // key, so a value is removed before any tombstone that hides it. A
+    // live value copied by an earlier compaction is older than the
+    // compaction, and any tombstone for it is newer; values in other
+    // segments precede their tombstones' segments in sequence. So the
+    // inputs are removed in order of their last sequence number.
+    std::sort(inputs.begin(), inputs.end(), [&c](std::uint32_t a, std::uint32_t b) {
+      return c.last[a] < c.last[b];
+    });
+    lock.lock();
+    for (std::uint32_t id : inputs) {
+      files_.erase(id);
+      remove_log_file(log_segment_path(dir_, id, "hint"));
+      remove_log_file(log_segment_path(dir_, id, "data"));
+    }
+  }
+
+  // Run compact() on a background thread. Only one compaction runs at
+  // a time; the returned future becomes ready when it completes.
+  std::shared_future<void> compact_async()
+  {
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+    if (!compaction_.valid() ||
+        compaction_.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      compaction_ = std::async(std::launch::async, [this] { compact(); }).share();
+    return compaction_;
+  }
+
+private:
+  // Copies live records into new segments, writing a hint file for each.
+  struct compactor
+  {
+    explicit compactor(log_store& s)
+      : store(s)
+    { }
+
+    // Copy the live records of segment id.
+    void copy(std::uint32_t id)
+    {
+      log_file const* in;
+      {
+        std::lock_guard<std::mutex> lock(store.mutex_);
+        in = &store.files_.at(id);
+      }
+      std::vector<byte> buf;
+      std::uint64_t off = 0;
+      std::uint64_t end = in->size();
+      while (off < end) {
+        std::uint64_t seq;
+        std::uint32_t klen, vlen;
+        if (!read_record(*in, off, buf, seq, klen, vlen))
+          break;
+        std::uint64_t next = off + buf.size();
+        last[id] = std::max(last[id], seq);
+        if (vlen != tombstone)
+          copy_live(id, off, buf, seq, klen, vlen);
+        off = next;
+      }
+    }
+
+    void copy_live(std::uint32_t id, std::uint64_t off, std::vector<byte> const& rec,
+                   std::uint64_t seq, std::uint32_t klen, std::uint32_t vlen)
+    {
+      std::string key(reinterpret_cast<char const*>(&rec[record_header]), klen);
+      {
+        std::lock_guard<std::mutex> lock(store.mutex_);
+        auto iter = store.index_.find(key);
+        if (iter == store.index_.end() ||
+            iter->second.file != id || iter->second.offset != off)
+          return;
+      }
+
+      if (!out || out.size() >= store.opts_.max_segment_size)
+        next_output();
+      std::uint64_t pos = out.append(rec.data(), rec.size());
+
+      byte h[hint_header];
+      std::memcpy(h, &seq, 8);
+      std::memcpy(h + 8, &klen, 4);
+      std::memcpy(h + 12, &vlen, 4);
+      std::memcpy(h + 16, &pos, 8);
+      hint.append(h, hint_header);
+      hint.append(key.data(), klen);
+
+      // The record is only published once the output is durable. Until
+      // then, remember where it went.
+      moved.push_back({std::move(key), {out_id, vlen, pos, seq}, id, off});
+    }
+
+    void next_output()
+    {
+      publish();
+      std::lock_guard<std::mutex> lock(store.mutex_);
+      out_id = store.next_id_++;
+      out = log_file(log_segment_path(store.dir_, out_id, "data.tmp"), true);
+      hint = log_file(log_segment_path(store.dir_, out_id, "hint.tmp"), true);
+    }
+
+    // Make the current output durable, install it as a segment, and
+    // repoint the index at the records that are still live.
+    void publish()
+    {
+      if (!out)
+        return;
+      out.sync();
+      hint.sync();
+      // Install the data before the hint; a hint without its data
+      // would be attributed to a later segment with the same id.
+      rename_log_file(log_segment_path(store.dir_, out_id, "data.tmp"),
+                      log_segment_path(store.dir_, out_id, "data"));
+      rename_log_file(log_segment_path(store.dir_, out_id, "hint.tmp"),
+                      log_segment_path(store.dir_, out_id, "hint"));
+      sync_log_dir(store.dir_);
+
+      std::lock_guard<std::mutex> lock(store.mutex_);
+      store.files_[out_id] = std::move(out);
+      for (auto& m : moved) {
+        auto iter = store.index_.find(m.key);
+        if (iter != store.index_.end() &&
+            iter->second.file == m.from && iter->second.offset == m.from_offset)
+          iter->second = m.to;
+      }
+      moved.clear();
+      out = log_file();
+      hint = log_file();
+    }
+
+    void finish()
+    {
+      publish();
+    }
+
+    struct moved_record
+    {
+      std::string key;
+      location to;
+      std::uint32_t from;
+      std::uint64_t from_offset;
+    };
+
+    log_store& store;
+    std::uint32_t out_id = 0;
+    log_file out;
+    log_file hint;
+    std::vector<moved_record> moved;
+
+    // The largest sequence number in each input segment.
+    std::map<std::uint32_t, std::uint64_t> last;
+  };
+
+  // Read the record at off into buf. Returns false if the record is
+  // truncated or corrupt, which marks the end of the usable log.
+  static bool read_record(log_file const& f, std::uint64_t off, std::vector<byte>& buf,
+                          std::uint64_t& seq, std::uint32_t& klen, std::uint32_t& vlen)
+  {
+    byte h[record_header];
+    if (!f.read_at(off, h, record_header))
+      return false;
+    std::uint64_t sum;
+    std::memcpy(&sum, h, 8);
+    std::memcpy(&seq, h + 8, 8);
+    std::memcpy(&klen, h + 16, 4);
+    std::memcpy(&vlen, h + 20, 4);
+    std::uint64_t len = record_header + klen + (vlen == tombstone ? 0 : vlen);
+    if (off + len > f.size())
+      return false;
+    buf.resize(len);
+    std::memcpy(buf.data(), h, record_header);
+    if (!f.read_at(off + record_header, buf.data() + record_header, len - record_header))
+      return false;
+    return checksum(buf.data() + 8, len - 8) == sum;
+  }
+
+  static std::uint64_t checksum(void const* p, std::size_t n)
+  {
+    H h;
+    h(p, n);
+    return h.value();
+  }
+
+  // Append a record for k to the active segment. A null value with
+  // length tombstone writes a deletion marker.
+  location write(std::string const& k, char const* v, std::uint32_t vlen)
+  {
+    if (k.size() >= tombstone)
+      throw std::length_error("log_store: key too large");
+    std::uint32_t klen = k.size();
+    std::size_t n = vlen == tombstone ? 0 : vlen;
+    std::vector<byte> rec(record_header + klen + n);
+    std::uint64_t seq = next_seq_++;
+    std::memcpy(&rec[8], &seq, 8);
+    std::memcpy(&rec[16], &klen, 4);
+    std::memcpy(&rec[20], &vlen, 4);
+    std::memcpy(&rec[record_header], k.data(), klen);
+    if (n)
+      std::memcpy(&rec[record_header + klen], v, n);
+    std::uint64_t sum = checksum(&rec[8], rec.size() - 8);
+    std::memcpy(&rec[0], &sum, 8);
+
+    std::uint32_t id = active_;
+    log_file& f = files_.at(id);
+    std::uint64_t off = f.append(rec.data(), rec.size());
+    if (opts_.sync)
+      f.sync();
+    if (f.size() >= opts_.max_segment_size)
+      roll();
+    return {id, vlen, off, seq};
+  }
+
+  // Start a new active segment.
+  void roll()
+  {
+    auto iter = files_.find(active_);
+    if (iter != files_.end() && iter->second.size() == 0)
+      return;
+    active_ = next_id_++;
+    files_[active_] = log_file(log_segment_path(dir_, active_, "data"), true);
+  }
+
+  // Rebuild the index from the segments in the directory. Tombstones
+  // are kept in the index until every segment has been read, since a
+  // compacted segment may hold an older value for a deleted key.
+  void recover()
+  {
+    std::vector<byte> buf;
+    for (std::uint32_t id : list_log_segments(dir_)) {
+      next_id_ = id + 1;
+      log_file f(log_segment_path(dir_, id, "data"), false);
+      log_file h(log_segment_path(dir_, id, "hint"), false);
+      if (h)
+        recover_hint(id, h);
+      else
+        recover_data(id, f, buf);
+      files_[id] = std::move(f);
+    }
+    for (auto iter = index_.begin(); iter != index_.end(); ) {
+      if (iter->second.len == tombstone)
+        iter = index_.erase(iter);
+      else
+        ++iter;
+    }
+  }
+
+  void recover_data(std::uint32_t id, log_file const& f, std::vector<byte>& buf)
+  {
+    std::uint64_t off = 0;
+    std::uint64_t seq;
+    std::uint32_t klen, vlen;
+    while (off < f.size() && read_record(f, off, buf, seq, klen, vlen)) {
+      std::string key(reinterpret_cast<char const*>(&buf[record_header]), klen);
+      recover_entry(std::move(key), {id, vlen, off, seq});
+      off += buf.size();
+    }
+  }
+
+  void recover_hint(std::uint32_t id, log_file const& h)
+  {
+    std::uint64_t off = 0;
+    byte e[hint_header];
+    while (h.read_at(off, e, hint_header)) {
+      std::uint64_t seq, pos;
+      std::uint32_t klen, vlen;
+      std::memcpy(&seq, e, 8);
+      std::memcpy(&klen, e + 8, 4);
+      std::memcpy(&vlen, e + 12, 4);
+      std::memcpy(&pos, e + 16, 8);
+      std::string key(klen, '\0');
+      if (klen && !h.read_at(off + hint_header, &key[0], klen))
+        break;
+      recover_entry(std::move(key), {id, vlen, pos, seq});
+      off += hint_header + klen;
+    }
+  }
+
+  void recover_entry(std::string&& key, location loc)
+  {
+    if (loc.seq >= next_seq_)
+      next_seq_ = loc.seq + 1;
+    auto ins = index_.emplace(std::move(key), loc);
+    if (!ins.second && ins.first->second.seq < loc.seq)
+      ins.first->second = loc;
+  }
+
+  std::string dir_;
+  options opts_;
+  mutable std::mutex mutex_;
+  index_type index_;
+  std::map<std::uint32_t, log_file> files_;
+  std::uint32_t active_ = 0;
+  std::uint32_t next_id_ = 1;
+  std::uint64_t next_seq_ = 1;
+  std::mutex compacting_;
+  std::mutex compaction_mutex_;
+  std::shared_future<void> compaction_;
+};
+
+
+} // namespace origin
+
+
+#endif
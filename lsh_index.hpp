@@ -0,0 +1,177 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_LSH_INDEX_HPP
+#define ORIGIN_LSH_INDEX_HPP
+
+// A locality-sensitive hashing index over MinHash signatures, using the
+// banding technique [1, ch. 3]. A signature of length b * r is split
+// into b bands of r rows. Each band is hashed with origin::hash<H> into
+// a table of its own, and two signatures are candidates if they agree
+// on every row of at least one band. Two sets with Jaccard similarity
+// s become candidates with probability 1 - (1 - s^r)^b, an S-curve
+// whose steepest point is near (1/b)^(1/r).
+//
+// A query touches exactly b buckets. Tables are keyed by band digest
+// only, so a digest collision yields a spurious candidate; candidates
+// should be verified against their signatures.
+//
+// Each band has its own table, so a batch of signatures is inserted in
+// parallel by giving each thread a disjoint set of bands.
+//
+// [1] J. Leskovec, A. Rajaraman and J. Ullman. Mining of Massive
+// Datasets, 2nd ed. Cambridge University Press, 2014.
+
+#include "minhash.hpp"
+
+#include <cmath>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+
+namespace origin
+{
+
+template<Hash_algorithm_64 H = fnv1a>
+class lsh_index
+{
+  // The rows of a band. The band number is appended so that equal
+  // rows in different bands have unrelated digests.
+  struct band
+  {
+    std::size_t number;
+    std::uint32_t const* rows;
+    std::size_t size;
+
+    template<Hash_algorithm A>
+    friend void hash_append(A& h, band const& b)
+    {
+      hash_append(h, b.number);
+      h(b.rows, b.size * sizeof(std::uint32_t));
+    }
+  };
+
+  using table = std::unordered_map<std::uint64_t, std::vector<std::uint64_t>>;
+
+public:
+  // Create an index for signatures of length bands * rows.
+  lsh_index(std::size_t bands, std::size_t rows, std::uint64_t seed = 0)
+    : bands_(bands), rows_(rows), hash_(H(seed)), tables_(bands)
+  {
+    if (bands == 0 || rows == 0)
+      throw std::invalid_argument("lsh_index: bad dimensions");
+  }
+
+  // Returns the approximate similarity at which a pair becomes a
+  // candidate with probability 1/2.
+  static double threshold(std::size_t bands, std::size_t rows)
+  {
+    return std::pow(1.0 / bands, 1.0 / rows);
+  }
+
+  // Add the signature of the object with the given id.
+  void insert(std::uint64_t id, minhash_signature const& s)
+  {
+    check(s);
+    for (std::size_t b = 0; b < bands_; ++b)
+      tables_[b][digest(s, b)].push_back(id);
+    ++size_;
+  }
+
+  // Add a batch of signatures, where sigs[i] belongs to ids[i], using
+  // the given number of threads.
+  void insert(std::vector<std::uint64_t> const& ids,
+              std::vector<minhash_signature> const& sigs,
+              unsigned threads = 1)
+  {
+    if (ids.size() != sigs.size())
+      throw std::invalid_argument("lsh_index: mismatched batch");
+    for (minhash_signature const& s : sigs)
+      check(s);
+    threads = std::max(1u, std::min<unsigned>(threads, bands_));
+    auto work = [&](unsigned t) {
+      for (std::size_t b = t; b < bands_; b += threads)
+        for (std::size_t i = 0; i < sigs.size(); ++i)
+          tables_[b][digest(sigs[i], b)].push_back(ids[i]);
+    };
+    std::vector<std::thread> ts;
+    for (unsigned t = 1; t < threads; ++t)
+      ts.emplace_back(work, t);
+    work(0);
+    for (std::thread& t : ts)
+      t.join();
+    size_ += sigs.size();
+  }
+
+  // Returns the ids of the candidate neighbors of a signature, in
+  // increasing order and without duplicates.
+  std::vector<std::uint64_t> query(minhash_signature const& s) const
+  {
+    check(s);
+    std::vector<std::uint64_t> out;
+    for (std::size_t b = 0; b < bands_; ++b) {
+      auto iter = tables_[b].find(digest(s, b));
+      if (iter != tables_[b].end())
+        out.insert(out.end(), iter->second.begin(), iter->second.end());
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+  }
+
+  // Returns every pair of distinct ids that share a bucket, as (a, b)
+  // with a < b, in increasing order and without duplicates.
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> candidate_pairs() const
+  {
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> out;
+    for (table const& t : tables_)
+      for (auto const& kv : t) {
+        std::vector<std::uint64_t> const& ids = kv.second;
+        for (std::size_t i = 0; i < ids.size(); ++i)
+          for (std::size_t j = i + 1; j < ids.size(); ++j)
+            if (ids[i] != ids[j])
+              out.emplace_back(std::min(ids[i], ids[j]), std::max(ids[i], ids[j]));
+      }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+  }
+
+  void clear()
+  {
+    for (table& t : tables_)
+      t.clear();
+    size_ = 0;
+  }
+
+  std::size_t bands() const { return bands_; }
+  std::size_t rows() const { return rows_; }
+
+  // Returns the number of signatures inserted.
+  std::size_t size() const { return size_; }
+
+private:
+  void check(minhash_signature const& s) const
+  {
+    if (s.size() != bands_ * rows_)
+      throw std::invalid_argument("lsh_index: bad signature length");
+  }
+
+  std::uint64_t digest(minhash_signature const& s, std::size_t b) const
+  {
+    return hash_(band{b, s.data() + b * rows_, rows_});
+  }
+
+  std::size_t bands_;
+  std::size_t rows_;
+  hash<H> hash_;
+  std::vector<table> tables_;
+  std::size_t size_ = 0;
+};
+
+
+} // namespace origin
+
+
+#endif
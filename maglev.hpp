@@ -0,0 +1,202 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_MAGLEV_HPP
+#define ORIGIN_MAGLEV_HPP
+
+// Maglev hashing [1] for load balancing.
+//
+// The lookup table has a prime number M of entries, each naming a
+// backend. Each backend has a preference list of the entries, which is
+// the permutation (offset + j * skip) mod M, with offset and skip taken
+// from the digest of its id. The table is populated by letting the
+// backends take turns claiming their next preferred free entry, which
+// gives each backend M / N entries (to within one). A lookup is one
+// hash of the key and one table index.
+//
+// rebuild() populates the table from scratch, visiting backends in
+// order of id, so every balancer with the same backends and seed has
+// the same table. Adding or removing a backend updates the table
+// incrementally, changing only about M / N entries: a removed backend's
+// entries are claimed by the others in turn, and an added backend
+// claims entries from its preference list, taking only those whose
+// owners have more than their new share. Incremental tables depend on
+// the order of the changes, so balancers that must agree should apply
+// the same changes, or rebuild.
+//
+// [1] D. Eisenbud et al. Maglev: a fast and reliable software network
+// load balancer. NSDI 2016.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+template<Hash_algorithm_64 H = fnv1a>
+class maglev_table
+{
+  static constexpr std::uint32_t none = -1;
+
+public:
+  // Create an empty table with m entries, where m is prime.
+  explicit maglev_table(std::size_t m = 65537, std::uint64_t seed = 0)
+    : m_(m), hash_(H(seed)), owner_(m, none), entries_(m)
+  {
+    if (m < 2 || m > 0xffffffffu || !prime(m))
+      throw std::invalid_argument("maglev_table: size must be prime");
+  }
+
+  // Returns the backend for a key. The table must not be empty.
+  template<Hashable_with<H> T>
+  std::uint64_t operator()(T const& t) const
+  {
+    std::uint64_t d = hash_mix(hash_(t));
+    return entries_[(static_cast<unsigned __int128>(d) * m_) >> 64];
+  }
+
+  // Add a backend, updating the table incrementally.
+  void insert(std::uint64_t id)
+  {
+    if (std::find(ids_.begin(), ids_.end(), id) != ids_.end())
+      return;
+    add(id);
+    std::uint32_t b = ids_.size() - 1;
+    if (b == 0) {
+      std::fill(owner_.begin(), owner_.end(), 0);
+      std::fill(entries_.begin(), entries_.end(), id);
+      counts_[0] = m_;
+      return;
+    }
+    std::size_t share = m_ / ids_.size();
+    for (std::size_t j = 0; counts_[b] < share; ++j) {
+      std::size_t c = slot(b, j);
+      std::uint32_t o = owner_[c];
+      if (o != b && counts_[o] > share) {
+        --counts_[o];
+        ++counts_[b];
+        owner_[c] = b;
+        entries_[c] = id;
+      }
+    }
+  }
+
+  // Remove a backend, updating the table incrementally.
+  void erase(std::uint64_t id)
+  {
+    auto iter = std::find(ids_.begin(), ids_.end(), id);
+    if (iter == ids_.end())
+      return;
+    std::uint32_t b = iter - ids_.begin();
+    std::uint32_t last = ids_.size() - 1;
+    for (std::uint32_t& o : owner_)
+      if (o == b)
+        o = none;
+      else if (o == last)
+        o = b;
+    ids_[b] = ids_[last];
+    offset_[b] = offset_[last];
+    skip_[b] = skip_[last];
+    counts_[b] = counts_[last];
+    ids_.pop_back();
+    offset_.pop_back();
+    skip_.pop_back();
+    counts_.pop_back();
+    if (ids_.empty())
+      return;
+
+    std::size_t n = std::count(owner_.begin(), owner_.end(), none);
+    populate(n, order());
+  }
+
+  // Populate the table from scratch.
+  void rebuild()
+  {
+    std::fill(owner_.begin(), owner_.end(), none);
+    std::fill(counts_.begin(), counts_.end(), 0);
+    if (!ids_.empty())
+      populate(m_, order());
+  }
+
+  // Returns the number of entries owned by each backend, in the order
+  // of backends().
+  std::vector<std::size_t> const& counts() const { return counts_; }
+  std::vector<std::uint64_t> const& backends() const { return ids_; }
+
+  std::size_t size() const { return m_; }
+
+private:
+  static bool prime(std::size_t m)
+  {
+    for (std::size_t d = 2; d * d <= m; ++d)
+      if (m % d == 0)
+        return false;
+    return true;
+  }
+
+  void add(std::uint64_t id)
+  {
+    std::uint64_t d = hash_mix(hash_(id));
+    ids_.push_back(id);
+    offset_.push_back((d >> 32) % m_);
+    skip_.push_back(std::uint32_t(d) % (m_ - 1) + 1);
+    counts_.push_back(0);
+  }
+
+  // Returns the j-th preferred entry of backend b.
+  std::size_t slot(std::uint32_t b, std::size_t j) const
+  {
+    return (offset_[b] + j * skip_[b]) % m_;
+  }
+
+  // Returns the backends in order of id.
+  std::vector<std::uint32_t> order() const
+  {
+    std::vector<std::uint32_t> v(ids_.size());
+    std::iota(v.begin(), v.end(), 0);
+    std::sort(v.begin(), v.end(), [this](std::uint32_t a, std::uint32_t b) {
+      return ids_[a] < ids_[b];
+    });
+    return v;
+  }
+
+  // Fill the n free entries of the table, with backends taking turns in
+  // the given order. Each backend walks its preference list from the
+  // start; entries already owned are skipped.
+  void populate(std::size_t n, std::vector<std::uint32_t> const& turns)
+  {
+    std::vector<std::size_t> next(ids_.size(), 0);
+    while (n > 0) {
+      for (std::uint32_t b : turns) {
+        std::size_t c = slot(b, next[b]);
+        while (owner_[c] != none)
+          c = slot(b, ++next[b]);
+        owner_[c] = b;
+        entries_[c] = ids_[b];
+        ++counts_[b];
+        ++next[b];
+        if (--n == 0)
+          break;
+      }
+    }
+  }
+
+  std::size_t m_;
+  hash<H> hash_;
+  std::vector<std::uint64_t> ids_;
+  std::vector<std::size_t> offset_;
+  std::vector<std::size_t> skip_;
+  std::vector<std::size_t> counts_;
+  std::vector<std::uint32_t> owner_;
+  std::vector<std::uint64_t> entries_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,230 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_MINHASH_HPP
+#define ORIGIN_MINHASH_HPP
+
+// MinHash signatures for estimating the Jaccard similarity of sets of
+// shingles. Each shingle is hashed once, with hash_append, and the k
+// signature values are computed from that one digest by one of two
+// schemes:
+//
+//  - One-permutation hashing [1]: the digest selects one of k bins and
+//    the bin keeps the minimum value. Empty bins are then filled by
+//    optimal densification [2], which copies the value of a bin chosen
+//    by a hash of the empty bin's index. This costs O(1) per shingle.
+//
+//  - Derived hashing: each of the k lanes computes its own value from
+//    the digest with a cheap 32-bit mix, and keeps the minimum. This
+//    costs O(k) per shingle, but the lane loop has no dependencies and
+//    vectorizes well. It is more accurate for very small sets.
+//
+// Signatures can be compressed to b bits per value [3].
+//
+// [1] P. Li, A. Owen and C. Zhang. One permutation hashing. NIPS 2012.
+//
+// [2] A. Shrivastava. Optimal densification for fast and accurate
+// minwise hashing. ICML 2017.
+//
+// [3] P. Li and A. C. Konig. b-Bit minwise hashing. WWW 2010.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+// A MinHash signature.
+using minhash_signature = std::vector<std::uint32_t>;
+
+
+// A signature compressed to b bits per value.
+struct bbit_signature
+{
+  unsigned bits;
+  std::size_t size;
+  std::vector<std::uint64_t> words;
+};
+
+
+// Returns the estimated Jaccard similarity of two signatures.
+inline double
+similarity(minhash_signature const& a, minhash_signature const& b)
+{
+  if (a.size() != b.size() || a.empty())
+    throw std::invalid_argument("similarity: incompatible signatures");
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < a.size(); ++i)
+    n += a[i] == b[i];
+  return double(n) / a.size();
+}
+
+
+// Compress a signature to b bits per value, 1 <= b <= 32.
+inline bbit_signature
+compress(minhash_signature const& s, unsigned b)
+{
+  if (b < 1 || b > 32)
+    throw std::invalid_argument("compress: bad width");
+  bbit_signature c {b, s.size(), std::vector<std::uint64_t>((s.size() * b + 63) / 64)};
+  std::uint64_t mask = (std::uint64_t(1) << b) - 1;
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    std::size_t bit = i * b;
+    std::uint64_t v = s[i] & mask;
+    c.words[bit / 64] |= v << (bit % 64);
+    if (bit % 64 + b > 64)
+      c.words[bit / 64 + 1] |= v >> (64 - bit % 64);
+  }
+  return c;
+}
+
+
+// Returns the estimated Jaccard similarity of two compressed
+// signatures. Two unrelated values agree on b bits with probability
+// 2^-b, which is corrected for.
+inline double
+similarity(bbit_signature const& a, bbit_signature const& b)
+{
+  if (a.bits != b.bits || a.size != b.size || a.size == 0)
+    throw std::invalid_argument("similarity: incompatible signatures");
+  std::uint64_t mask = (std::uint64_t(1) << a.bits) - 1;
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < a.size; ++i) {
+    std::size_t bit = i * a.bits, w = bit / 64, o = bit % 64;
+    std::uint64_t x = a.words[w] ^ b.words[w];
+    std::uint64_t v = x >> o;
+    if (o + a.bits > 64)
+      v |= (a.words[w + 1] ^ b.words[w + 1]) << (64 - o);
+    n += (v & mask) == 0;
+  }
+  double p = double(n) / a.size;
+  double c = 1.0 / (std::uint64_t(1) << a.bits);
+  return std::max(0.0, (p - c) / (1 - c));
+}
+
+
+// Computes MinHash signatures of length k.
+template<Hash_algorithm_64 H = fnv1a>
+class minhash
+{
+  static constexpr std::uint32_t empty = std::numeric_limits<std::uint32_t>::max();
+
+public:
+  enum scheme { one_permutation, derived };
+
+  explicit minhash(std::size_t k, scheme s = one_permutation, std::uint64_t seed = 0)
+    : k_(k), scheme_(s), seed_(seed), hash_(H(seed))
+  {
+    if (k == 0 || k > 0xffffffffu)
+      throw std::invalid_argument("minhash: bad signature length");
+  }
+
+  // Returns the signature of the shingles in [first, last).
+  template<Forward_iterator I>
+    requires Hashable_type<H, Value_type<I>>()
+  minhash_signature operator()(I first, I last) const
+  {
+    minhash_signature sig = start();
+    for (; first != last; ++first)
+      update(sig, hash_mix(hash_(*first)));
+    return finish(sig);
+  }
+
+  // Returns the signature of the w-shingles of the tokens in [first,
+  // last): each window of w consecutive tokens is hash_appended to one
+  // hasher. A sequence shorter than w is a single shingle.
+  template<Forward_iterator I>
+    requires Hashable_type<H, Value_type<I>>()
+  minhash_signature shingles(I first, I last, std::size_t w) const
+  {
+    minhash_signature sig = start();
+    if (first == last)
+      return sig;
+    I end = first;
+    for (std::size_t i = 0; i < w && end != last; ++i)
+      ++end;
+    while (true) {
+      H hasher = hash_.proto_;
+      for (I i = first; i != end; ++i)
+        hash_append(hasher, *i);
+      update(sig, hash_mix(hasher.value()));
+      if (end == last)
+        break;
+      ++first;
+      ++end;
+    }
+    return finish(sig);
+  }
+
+  // Returns an empty partial signature.
+  minhash_signature start() const
+  {
+    return minhash_signature(k_, empty);
+  }
+
+  // Add a shingle digest, hash_mix(hash<H>(seed)(shingle)), to a partial
+  // signature.
+  void update(minhash_signature& sig, std::uint64_t d) const
+  {
+    if (scheme_ == one_permutation) {
+      std::size_t i = (static_cast<unsigned __int128>(d) * k_) >> 64;
+      sig[i] = std::min(sig[i], static_cast<std::uint32_t>(d));
+      return;
+    }
+    std::uint32_t h1 = d >> 32;
+    std::uint32_t h2 = static_cast<std::uint32_t>(d) | 1;
+    std::uint32_t* s = sig.data();
+    for (std::size_t i = 0; i < k_; ++i) {
+      std::uint32_t x = h1 + std::uint32_t(i) * h2;
+      x ^= x >> 16;
+      x *= 0x7feb352du;
+      x ^= x >> 15;
+      x *= 0x846ca68bu;
+      x ^= x >> 16;
+      s[i] = std::min(s[i], x);
+    }
+  }
+
+  // Complete a signature. For one-permutation hashing, this fills the
+  // empty bins.
+  minhash_signature finish(minhash_signature sig) const
+  {
+    if (scheme_ == derived)
+      return sig;
+    std::vector<std::size_t> holes;
+    for (std::size_t i = 0; i < k_; ++i)
+      if (sig[i] == empty)
+        holes.push_back(i);
+    if (holes.size() == k_)
+      return sig;
+    for (std::size_t i : holes) {
+      for (std::uint64_t a = 1; ; ++a) {
+        std::uint64_t r = hash_mix(seed_ ^ (std::uint64_t(i) << 32) ^ a);
+        std::size_t j = (static_cast<unsigned __int128>(r) * k_) >> 64;
+        if (sig[j] != empty && !std::binary_search(holes.begin(), holes.end(), j)) {
+          sig[i] = sig[j];
+          break;
+        }
+      }
+    }
+    return sig;
+  }
+
+  std::size_t size() const { return k_; }
+
+private:
+  std::size_t k_;
+  scheme scheme_;
+  std::uint64_t seed_;
+  hash<H> hash_;
+};
+
+
+} // namespace origin
+
+
+#endif
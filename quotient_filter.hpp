@@ -0,0 +1,545 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_QUOTIENT_FILTER_HPP
+#define ORIGIN_QUOTIENT_FILTER_HPP
+
+// A counting quotient filter [1]. The leading q + r bits of a key's
+// digest form its fingerprint: the first q bits (the quotient) select a
+// home slot and the remaining r bits (the remainder) are stored in the
+// table. The remainders of a quotient are kept sorted in a contiguous
+// run, which starts at or after the home slot.
+//
+// Runs are located with rank and select over per-block metadata, as in
+// the rank-and-select quotient filter: for each block of 64 slots we
+// keep an "occupied" bit per quotient, a "run end" bit per slot, and
+// the offset of the run end of the last quotient at or before the start
+// of the block.
+//
+// Counts are stored in variable length: a remainder with count c > 1 is
+// followed by the digits of c - 1 in base 2^r, each in its own slot.
+// Unlike [1], which encodes counters in-band, counter slots are marked
+// by an extra metadata bit; this costs one bit per slot but keeps the
+// encoding unambiguous for every remainder.
+//
+// Because the fingerprints are kept in order, a filter can be resized
+// (moving one remainder bit into the quotient) and two filters can be
+// merged without access to the original keys, each in a linear pass.
+//
+// [1] P. Pandey et al. A general-purpose counting filter: making every
+// bit count. SIGMOD 2017.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+template<Hash_algorithm_64 H = fnv1a>
+class counting_quotient_filter
+{
+  static constexpr std::size_t npos = -1;
+
+public:
+  // An entry in the filter: a fingerprint and its count.
+  struct entry
+  {
+    std::uint64_t fingerprint;
+    std::uint64_t count;
+  };
+
+  // Create a filter with 2^q slots and r-bit remainders. The filter
+  // doubles its slots (taking a bit from the remainder) when it fills.
+  counting_quotient_filter(unsigned q, unsigned r, std::uint64_t seed = 0)
+    : seed_(seed), hash_(H(seed))
+  {
+    if (q < 1 || r < 2 || q + r > 64 || r > 57)
+      throw std::invalid_argument("counting_quotient_filter: bad parameters");
+    init(q, r);
+  }
+
+  // Add c occurrences of an object.
+  template<Hashable_with<H> T>
+  void insert(T const& t, std::uint64_t c = 1)
+  {
+    insert_fingerprint(fingerprint(t), c);
+  }
+
+  // Returns the (approximate) number of occurrences of an object. The
+  // count is never less than the true count.
+  template<Hashable_with<H> T>
+  std::uint64_t count(T const& t) const
+  {
+    return count_fingerprint(fingerprint(t));
+  }
+
+  template<Hashable_with<H> T>
+  bool contains(T const& t) const
+  {
+    return count(t) != 0;
+  }
+
+  // Returns the fingerprint of an object.
+  template<Hashable_with<H> T>
+  std::uint64_t fingerprint(T const& t) const
+  {
+    return hash_mix(hash_(t)) >> (64 - qbits_ - rbits_);
+  }
+
+  void insert_fingerprint(std::uint64_t h, std::uint64_t c)
+  {
+    if (c == 0)
+      return;
+    while (!try_insert(h, c))
+      resize(qbits_ + 1);
+  }
+
+  std::uint64_t count_fingerprint(std::uint64_t h) const
+  {
+    std::size_t q = h >> rbits_;
+    std::uint64_t rem = h & rmask_;
+    if (!test(occupied_, q))
+      return 0;
+    for (std::size_t s = run_start(q); ; ) {
+      std::size_t e = entry_end(s);
+      std::uint64_t x = get(s);
+      if (x == rem)
+        return decode(s, e);
+      if (x > rem || test(runend_, e))
+        return 0;
+      s = e + 1;
+    }
+  }
+
+  // Resize the filter to 2^q home slots, moving bits between the
+  // quotient and the remainder.
+  void resize(unsigned q)
+  {
+    unsigned p = qbits_ + rbits_;
+    if (q < 1 || q + 2 > p)
+      throw std::length_error("counting_quotient_filter: cannot resize");
+    counting_quotient_filter f(q, p - q, seed_);
+    for (cursor i(*this); i; ++i)
+      f.insert_fingerprint(i->fingerprint, i->count);
+    swap(f);
+  }
+
+  // Merge two filters built with the same seed and fingerprint size.
+  // The entries of both are visited in fingerprint order, so every
+  // insertion into the result appends to it.
+  static counting_quotient_filter merge(counting_quotient_filter const& a,
+                                        counting_quotient_filter const& b)
+  {
+    if (a.seed_ != b.seed_ || a.qbits_ + a.rbits_ != b.qbits_ + b.rbits_)
+      throw std::invalid_argument("counting_quotient_filter: incompatible filters");
+    unsigned q = std::max(a.qbits_, b.qbits_);
+    while ((std::size_t(95) << q) / 100 < a.used_ + b.used_ && q + 2 < a.qbits_ + a.rbits_)
+      ++q;
+    counting_quotient_filter f(q, a.qbits_ + a.rbits_ - q, a.seed_);
+    cursor i(a), j(b);
+    while (i || j) {
+      if (!j || (i && i->fingerprint < j->fingerprint)) {
+        f.insert_fingerprint(i->fingerprint, i->count);
+        ++i;
+      } else if (!i || j->fingerprint < i->fingerprint) {
+        f.insert_fingerprint(j->fingerprint, j->count);
+        ++j;
+      } else {
+        f.insert_fingerprint(i->fingerprint, i->count + j->count);
+        ++i;
+        ++j;
+      }
+    }
+    return f;
+  }
+
+  // Visits the entries of a filter in increasing fingerprint order.
+  class cursor
+  {
+  public:
+    explicit cursor(counting_quotient_filter const& f)
+      : f_(&f), q_(f.next_occupied(0)), s_(q_)
+    {
+      read();
+    }
+
+    explicit operator bool() const { return q_ != npos; }
+    entry const& operator*() const { return cur_; }
+    entry const* operator->() const { return &cur_; }
+
+    cursor& operator++()
+    {
+      std::size_t e = f_->entry_end(s_);
+      bool last = test(f_->runend_, e);
+      s_ = e + 1;
+      if (last) {
+        q_ = f_->next_occupied(q_ + 1);
+        s_ = std::max(s_, q_);
+      }
+      read();
+      return *this;
+    }
+
+  private:
+    void read()
+    {
+      if (q_ == npos)
+        return;
+      cur_.fingerprint = (std::uint64_t(q_) << f_->rbits_) | f_->get(s_);
+      cur_.count = f_->decode(s_, f_->entry_end(s_));
+    }
+
+    counting_quotient_filter const* f_;
+    std::size_t q_;
+    std::size_t s_;
+    entry cur_;
+  };
+
+  void swap(counting_quotient_filter& x)
+  {
+    std::swap(qbits_, x.qbits_);
+    std::swap(rbits_, x.rbits_);
+    std::swap(rmask_, x.rmask_);
+    std::swap(nslots_, x.nslots_);
+    std::swap(used_, x.used_);
+    std::swap(seed_, x.seed_);
+    std::swap(hash_, x.hash_);
+    slots_.swap(x.slots_);
+    occupied_.swap(x.occupied_);
+    runend_.swap(x.runend_);
+    counter_.swap(x.counter_);
+    inuse_.swap(x.inuse_);
+    offsets_.swap(x.offsets_);
+  }
+
+  unsigned quotient_bits() const { return qbits_; }
+  unsigned remainder_bits() const { return rbits_; }
+  std::size_t slots_used() const { return used_; }
+
+  std::size_t size_in_bytes() const
+  {
+    return 8 * (slots_.size() + 4 * occupied_.size()) + 4 * offsets_.size();
+  }
+
+private:
+  void init(unsigned q, unsigned r)
+  {
+    qbits_ = q;
+    rbits_ = r;
+    rmask_ = (std::uint64_t(1) << r) - 1;
+    // Slack past the last home slot absorbs the runs that spill over.
+    std::size_t home = std::size_t(1) << q;
+    std::size_t slack = 64 + 4 * static_cast<std::size_t>(std::sqrt(double(home)));
+    std::size_t blocks = (home + slack + 63) / 64;
+    nslots_ = blocks * 64;
+    used_ = 0;
+    slots_.assign((nslots_ * r + 63) / 64 + 1, 0);
+    occupied_.assign(blocks, 0);
+    runend_.assign(blocks, 0);
+    counter_.assign(blocks, 0);
+    inuse_.assign(blocks, 0);
+    offsets_.assign(blocks, -1);
+  }
+
+  // Bit vectors.
+
+  static bool test(std::vector<std::uint64_t> const& v, std::size_t i)
+  {
+    return (v[i / 64] >> (i % 64)) & 1;
+  }
+
+  static void assign(std::vector<std::uint64_t>& v, std::size_t i, bool b)
+  {
+    std::uint64_t m = std::uint64_t(1) << (i % 64);
+    v[i / 64] = b ? v[i / 64] | m : v[i / 64] & ~m;
+  }
+
+  // Packed r-bit slots.
+
+  std::uint64_t get(std::size_t i) const
+  {
+    std::size_t bit = i * rbits_;
+    std::size_t w = bit / 64, o = bit % 64;
+    std::uint64_t x = slots_[w] >> o;
+    if (o + rbits_ > 64)
+      x |= slots_[w + 1] << (64 - o);
+    return x & rmask_;
+  }
+
+  void set(std::size_t i, std::uint64_t x)
+  {
+    std::size_t bit = i * rbits_;
+    std::size_t w = bit / 64, o = bit % 64;
+    slots_[w] = (slots_[w] & ~(rmask_ << o)) | (x << o);
+    if (o + rbits_ > 64) {
+      unsigned k = 64 - o;
+      slots_[w + 1] = (slots_[w + 1] & ~(rmask_ >> k)) | (x >> k);
+    }
+  }
+
+  // Rank and select.
+
+  // Returns the number of occupied quotients in (a, b].
+  std::size_t rank_occupied(std::size_t a, std::size_t b) const
+  {
+    std::size_t n = 0;
+    for (std::size_t i = a + 1; i <= b; ) {
+      std::size_t w = i / 64, o = i % 64;
+      std::size_t hi = std::min(b, w * 64 + 63);
+      std::uint64_t x = occupied_[w] >> o;
+      unsigned len = hi - i + 1;
+      if (len < 64)
+        x &= (std::uint64_t(1) << len) - 1;
+      n += __builtin_popcountll(x);
+      i = hi + 1;
+    }
+    return n;
+  }
+
+  // Returns the position of the d-th (d >= 1) run end at or after i.
+  std::size_t select_runend(std::size_t i, std::size_t d) const
+  {
+    std::size_t w = i / 64;
+    std::uint64_t x = runend_[w] & (~std::uint64_t(0) << (i % 64));
+    while (true) {
+      std::size_t n = __builtin_popcountll(x);
+      if (n >= d) {
+        while (--d)
+          x &= x - 1;
+        return w * 64 + __builtin_ctzll(x);
+      }
+      d -= n;
+      x = runend_[++w];
+    }
+  }
+
+  // Returns the position of the last run end of the quotients at or
+  // before x, using the offset of block b (whose start is at most x).
+  // Returns npos if that run ends before the start of block b.
+  std::size_t run_end_from(std::size_t b, std::size_t x) const
+  {
+    std::size_t i = b * 64;
+    std::int64_t o = offsets_[b];
+    std::size_t d = rank_occupied(i, x);
+    if (d == 0)
+      return o >= 0 ? i + o : npos;
+    return select_runend(o >= 0 ? i + o + 1 : i, d);
+  }
+
+  std::size_t run_end(std::size_t x) const
+  {
+    return run_end_from(x / 64, x);
+  }
+
+  // Returns the position of the first slot of the run of quotient q.
+  std::size_t run_start(std::size_t q) const
+  {
+    if (q == 0)
+      return 0;
+    std::size_t e = run_end(q - 1);
+    return e == npos || e < q ? q : e + 1;
+  }
+
+  // Recompute the offsets of the blocks whose start is in [a, b].
+  void update_offsets(std::size_t a, std::size_t b)
+  {
+    for (std::size_t k = (a + 63) / 64; k * 64 <= b && k < offsets_.size(); ++k) {
+      std::size_t i = k * 64;
+      std::size_t e;
+      if (k == 0)
+        e = test(occupied_, 0) ? select_runend(0, 1) : npos;
+      else
+        e = run_end_from(k - 1, i);
+      offsets_[k] = e != npos && e >= i ? std::int64_t(e - i) : -1;
+    }
+  }
+
+  std::size_t next_occupied(std::size_t q) const
+  {
+    std::size_t home = std::size_t(1) << qbits_;
+    for (; q < home; q = (q / 64 + 1) * 64) {
+      std::uint64_t x = occupied_[q / 64] & (~std::uint64_t(0) << (q % 64));
+      if (x) {
+        std::size_t r = q / 64 * 64 + __builtin_ctzll(x);
+        return r < home ? r : npos;
+      }
+    }
+    return npos;
+  }
+
+  // Entries and counters.
+
+  // Returns the last slot of the entry starting at s.
+  std::size_t entry_end(std::size_t s) const
+  {
+    while (s + 1 < nslots_ && test(counter_, s + 1))
+      ++s;
+    return s;
+  }
+
+  std::uint64_t decode(std::size_t s, std::size_t e) const
+  {
+    std::uint64_t c = 0;
+    for (std::size_t i = e; i > s; --i)
+      c = (c << rbits_) | get(i);
+    return c + 1;
+  }
+
+  std::size_t digits(std::uint64_t c) const
+  {
+    std::size_t n = 0;
+    for (--c; c; c >>= rbits_)
+      ++n;
+    return n;
+  }
+
+  void encode(std::size_t s, std::uint64_t c)
+  {
+    --c;
+    for (std::size_t i = s + 1; c; ++i, c >>= rbits_) {
+      set(i, c & rmask_);
+      assign(counter_, i, true);
+    }
+  }
+
+  // Returns true if there are k empty slots at or after i.
+  bool has_room(std::size_t i, std::size_t k) const
+  {
+    for (std::size_t w = i / 64; w < inuse_.size() && k; ++w) {
+      std::uint64_t x = ~inuse_[w];
+      if (w == i / 64)
+        x &= ~std::uint64_t(0) << (i % 64);
+      std::size_t n = __builtin_popcountll(x);
+      k -= std::min(k, n);
+    }
+    return k == 0;
+  }
+
+  // Shift the slots in [i, e) right by one, where e is the first empty
+  // slot at or after i, and clear slot i. Returns e.
+  std::size_t open_slot(std::size_t i)
+  {
+    std::size_t w = i / 64;
+    std::uint64_t x = ~inuse_[w] & (~std::uint64_t(0) << (i % 64));
+    while (!x)
+      x = ~inuse_[++w];
+    std::size_t e = w * 64 + __builtin_ctzll(x);
+    for (std::size_t s = e; s > i; --s) {
+      set(s, get(s - 1));
+      assign(runend_, s, test(runend_, s - 1));
+      assign(counter_, s, test(counter_, s - 1));
+    }
+    assign(inuse_, e, true);
+    assign(runend_, i, false);
+    assign(counter_, i, false);
+    ++used_;
+    return e;
+  }
+
+  // Open k slots starting at i. Returns the last slot that was shifted
+  // into.
+  std::size_t open_slots(std::size_t i, std::size_t k)
+  {
+    std::size_t last = i;
+    for (std::size_t j = 0; j < k; ++j)
+      last = std::max(last, open_slot(i + j));
+    return last;
+  }
+
+  // Insert c occurrences of fingerprint h. Returns false (with the
+  // filter unchanged) if the filter is too full.
+  bool try_insert(std::uint64_t h, std::uint64_t c)
+  {
+    std::size_t q = h >> rbits_;
+    std::uint64_t rem = h & rmask_;
+    std::size_t k = 1 + digits(c);
+    std::size_t home = std::size_t(1) << qbits_;
+
+    if (!test(occupied_, q)) {
+      std::size_t e = run_end(q);
+      std::size_t pos = e == npos || e < q ? q : e + 1;
+      if (used_ + k > home * 95 / 100 || !has_room(pos, k))
+        return false;
+      std::size_t last = open_slots(pos, k);
+      set(pos, rem);
+      encode(pos, c);
+      assign(runend_, pos + k - 1, true);
+      assign(occupied_, q, true);
+      update_offsets(q, last);
+      return true;
+    }
+
+    // Find the entry for rem, or the position at which to insert it.
+    std::size_t s = run_start(q);
+    while (true) {
+      std::size_t e = entry_end(s);
+      std::uint64_t x = get(s);
+      if (x == rem) {
+        std::uint64_t n = decode(s, e) + c;
+        std::size_t grow = 1 + digits(n) - (e - s + 1);
+        if (grow && (used_ + grow > home * 95 / 100 || !has_room(e + 1, grow)))
+          return false;
+        std::size_t last = e;
+        if (grow) {
+          bool end = test(runend_, e);
+          last = open_slots(e + 1, grow);
+          if (end) {
+            assign(runend_, e, false);
+            assign(runend_, e + grow, true);
+          }
+        }
+        encode(s, n);
+        update_offsets(q, last);
+        return true;
+      }
+      if (x > rem)
+        break;
+      if (test(runend_, e)) {
+        // Append to the end of the run.
+        if (used_ + k > home * 95 / 100 || !has_room(e + 1, k))
+          return false;
+        std::size_t last = open_slots(e + 1, k);
+        assign(runend_, e, false);
+        assign(runend_, e + k, true);
+        set(e + 1, rem);
+        encode(e + 1, c);
+        update_offsets(q, last);
+        return true;
+      }
+      s = e + 1;
+    }
+
+    // Insert before the entry at s.
+    if (used_ + k > home * 95 / 100 || !has_room(s, k))
+      return false;
+    std::size_t last = open_slots(s, k);
+    set(s, rem);
+    encode(s, c);
+    update_offsets(q, last);
+    return true;
+  }
+
+  unsigned qbits_;
+  unsigned rbits_;
+  std::uint64_t rmask_;
+  std::size_t nslots_;
+  std::size_t used_;
+  std::uint64_t seed_;
+  hash<H> hash_;
+  std::vector<std::uint64_t> slots_;
+  std::vector<std::uint64_t> occupied_;
+  std::vector<std::uint64_t> runend_;
+  std::vector<std::uint64_t> counter_;
+  std::vector<std::uint64_t> inuse_;
+  std::vector<std::int32_t> offsets_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,387 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_RADIX_PARTITION_HPP
+#define ORIGIN_RADIX_PARTITION_HPP
+
+// Radix partitioning of tuples by the bits of their digests [1, 2].
+//
+// Each tuple's key is hashed with origin::hash<H> and mixed, in
+// batches. A pass distributes the tuples (and their digests, so that
+// later passes need not rehash) to 2^b partitions by b of the digest's
+// high bits. Writing tuples directly to 2^b output streams costs a TLB
+// entry and a cache line per stream, so a large fanout thrashes both.
+// Instead, each pass keeps one cache-line buffer per partition (a
+// software write-combining buffer) and writes a buffer to the output
+// only when it is full, with non-temporal stores that bypass the cache.
+// A partitioning with more bits than a single pass can handle well is
+// done in several passes, each refining the partitions of the last.
+//
+// The low-level functions (histogram, prefix_sum, scatter) let threads
+// partition disjoint parts of the input in parallel without locks:
+// each thread counts its part, an exclusive prefix sum over the counts
+// in (partition, thread) order gives each thread its own output range
+// in every partition, and each thread then scatters its part.
+//
+// The buffers are used only when the tuple size divides the cache line
+// and the output is cache-line aligned; otherwise scatter() skips them
+// and stores each tuple directly into the output. Full buffers are
+// written with non-temporal stores when SSE2 is available, and copied
+// with ordinary stores otherwise.
+//
+// [1] S. Manegold, P. Boncz and M. Kersten. Optimizing main-memory join
+// on modern hardware. IEEE TKDE 14(4), 2002.
+//
+// [2] C. Balkesen et al. Main-memory hash joins on multi-core CPUs:
+// tuning to the underlying hardware. ICDE 2013.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+
+namespace origin
+{
+
+// -------------------------------------------------------------------------- //
+// Cache-aligned storage
+
+constexpr std::size_t cache_line_size = 64;
+
+
+// An allocator whose storage is aligned to a cache line.
+template<typename T>
+struct cache_aligned_allocator
+{
+  using value_type = T;
+
+  cache_aligned_allocator() = default;
+
+  template<typename U>
+  cache_aligned_allocator(cache_aligned_allocator<U> const&) { }
+
+  T* allocate(std::size_t n)
+  {
+    void* p;
+    if (posix_memalign(&p, cache_line_size, std::max<std::size_t>(n * sizeof(T), 1)))
+      throw std::bad_alloc();
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, std::size_t)
+  {
+    std::free(p);
+  }
+
+  template<typename U>
+  bool operator==(cache_aligned_allocator<U> const&) const { return true; }
+
+  template<typename U>
+  bool operator!=(cache_aligned_allocator<U> const&) const { return false; }
+};
+
+
+template<typename T>
+using cache_aligned_vector = std::vector<T, cache_aligned_allocator<T>>;
+
+
+namespace radix_detail
+{
+
+// Copy a cache line from src to dst, both aligned, bypassing the cache
+// if possible.
+inline void
+stream_line(void* dst, void const* src)
+{
+#if defined(__SSE2__)
+  __m128i* d = static_cast<__m128i*>(dst);
+  __m128i const* s = static_cast<__m128i const*>(src);
+  for (int i = 0; i < 4; ++i)
+    _mm_stream_si128(d + i, _mm_load_si128(s + i));
+#else
+  std::memcpy(dst, src, cache_line_size);
+#endif
+}
+
+
+// Order non-temporal stores before later stores.
+inline void
+store_fence()
+{
+#if defined(__SSE2__)
+  _mm_sfence();
+#endif
+}
+
+
+// One cache-line buffer per partition for elements of type E. An
+// element destined for position k of the output is buffered in slot
+// k mod L of its partition's line, where L is the number of elements
+// per line, so a full buffer maps to one aligned line of the output.
+template<typename E>
+struct wc_buffers
+{
+  static constexpr std::size_t per_line =
+    sizeof(E) <= cache_line_size ? cache_line_size / sizeof(E) : 1;
+
+  // Returns true if writes of E to out can be combined.
+  static bool usable(E const* out)
+  {
+    return cache_line_size % sizeof(E) == 0
+        && reinterpret_cast<std::uintptr_t>(out) % cache_line_size == 0;
+  }
+
+  explicit wc_buffers(std::size_t fanout)
+    : lines(fanout * per_line)
+  { }
+
+  // Buffer x for position k of partition p, whose part of the output
+  // starts at first. A full line is streamed to the output if it lies
+  // entirely within the partition's part; the first line of a part may
+  // be shared with another, and is written element by element.
+  void put(std::size_t p, std::size_t k, E const& x, E* out, std::size_t first)
+  {
+    E* line = &lines[p * per_line];
+    std::size_t slot = k % per_line;
+    line[slot] = x;
+    if (slot == per_line - 1) {
+      std::size_t start = k - slot;
+      if (start >= first)
+        stream_line(out + start, line);
+      else
+        for (std::size_t j = first; j <= k; ++j)
+          out[j] = line[j % per_line];
+    }
+  }
+
+  // Write the partial line of partition p, which ends before position
+  // k, to the output.
+  void flush(std::size_t p, std::size_t k, E* out, std::size_t first)
+  {
+    E const* line = &lines[p * per_line];
+    for (std::size_t j = std::max(k - k % per_line, first); j < k; ++j)
+      out[j] = line[j % per_line];
+  }
+
+  cache_aligned_vector<E> lines;
+};
+
+// Run f(0), ..., f(n - 1) on n threads, the first on this one.
+template<typename F>
+void
+run(std::size_t n, F f)
+{
+  std::vector<std::thread> ts;
+  for (std::size_t t = 1; t < n; ++t)
+    ts.emplace_back(f, t);
+  if (n > 0)
+    f(0);
+  for (std::thread& t : ts)
+    t.join();
+}
+
+} // namespace radix_detail
+
+
+// -------------------------------------------------------------------------- //
+// Radix partitioning
+
+// Tuples and their digests, grouped into partitions. Partition i is the
+// range [bounds[i], bounds[i + 1]).
+template<typename T>
+struct partitioned
+{
+  cache_aligned_vector<T> items;
+  cache_aligned_vector<std::uint64_t> digests;
+  std::vector<std::size_t> bounds;
+
+  std::size_t partitions() const { return bounds.size() - 1; }
+};
+
+
+template<typename T, Hash_algorithm_64 H = fnv1a>
+class radix_partitioner
+{
+  static_assert(std::is_trivially_copyable<T>::value, "tuples must be trivially copyable");
+
+public:
+  // The largest number of bits partitioned in one pass by default.
+  static constexpr unsigned max_pass_bits = 10;
+
+  // Create a partitioner into 2^bits partitions, using the given number
+  // of passes, or as few as needed if passes is 0.
+  explicit radix_partitioner(unsigned bits, unsigned passes = 0, std::uint64_t seed = 0)
+    : hash_(H(seed))
+  {
+    if (bits == 0 || bits > 24)
+      throw std::invalid_argument("radix_partitioner: bad number of bits");
+    if (passes == 0)
+      passes = (bits + max_pass_bits - 1) / max_pass_bits;
+    if (passes > bits)
+      throw std::invalid_argument("radix_partitioner: too many passes");
+    for (unsigned i = 0; i < passes; ++i)
+      pass_bits_.push_back(bits / passes + (i < bits % passes));
+  }
+
+  // Compute the mixed digests of key(in[i]) for i in [0, n).
+  template<typename K>
+  void hash_keys(T const* in, std::size_t n, std::uint64_t* ds, K key) const
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      ds[i] = hash_mix(hash_(key(in[i])));
+  }
+
+  // Add the number of digests in each of the 2^bits partitions given by
+  // (d >> shift) to hist.
+  static void histogram(std::uint64_t const* ds, std::size_t n, unsigned shift,
+                        unsigned bits, std::size_t* hist)
+  {
+    std::uint64_t mask = (std::uint64_t(1) << bits) - 1;
+    for (std::size_t i = 0; i < n; ++i)
+      ++hist[(ds[i] >> shift) & mask];
+  }
+
+  // Replace the per-thread histograms with the position at which each
+  // thread starts writing each partition, where partitions are laid out
+  // in order starting at base and, within a partition, threads are in
+  // order. Returns the bounds of the partitions.
+  static std::vector<std::size_t> prefix_sum(std::vector<std::vector<std::size_t>>& hists,
+                                             std::size_t base = 0)
+  {
+    std::size_t fanout = hists.empty() ? 0 : hists[0].size();
+    std::vector<std::size_t> bounds(fanout + 1);
+    std::size_t sum = base;
+    for (std::size_t p = 0; p < fanout; ++p) {
+      bounds[p] = sum;
+      for (std::vector<std::size_t>& h : hists) {
+        std::size_t c = h[p];
+        h[p] = sum;
+        sum += c;
+      }
+    }
+    bounds[fanout] = sum;
+    return bounds;
+  }
+
+  // Scatter in[0, n) and their digests to out and out_ds, where the
+  // tuples of partition p go to positions starting at start[p].
+  static void scatter(T const* in, std::uint64_t const* ds, std::size_t n,
+                      unsigned shift, unsigned bits, std::size_t const* start,
+                      T* out, std::uint64_t* out_ds)
+  {
+    std::size_t fanout = std::size_t(1) << bits;
+    std::uint64_t mask = fanout - 1;
+    std::vector<std::size_t> pos(start, start + fanout);
+    if (!radix_detail::wc_buffers<T>::usable(out)
+        || !radix_detail::wc_buffers<std::uint64_t>::usable(out_ds)) {
+      for (std::size_t i = 0; i < n; ++i) {
+        std::size_t k = pos[(ds[i] >> shift) & mask]++;
+        out[k] = in[i];
+        out_ds[k] = ds[i];
+      }
+      return;
+    }
+
+    radix_detail::wc_buffers<T> items(fanout);
+    radix_detail::wc_buffers<std::uint64_t> digests(fanout);
+    for (std::size_t i = 0; i < n; ++i) {
+      std::size_t p = (ds[i] >> shift) & mask;
+      std::size_t k = pos[p]++;
+      items.put(p, k, in[i], out, start[p]);
+      digests.put(p, k, ds[i], out_ds, start[p]);
+    }
+    for (std::size_t p = 0; p < fanout; ++p) {
+      items.flush(p, pos[p], out, start[p]);
+      digests.flush(p, pos[p], out_ds, start[p]);
+    }
+    radix_detail::store_fence();
+  }
+
+  // Partition in[0, n) by the digests of key(in[i]), using the given
+  // number of threads.
+  template<typename K>
+  partitioned<T> partition(T const* in, std::size_t n, K key, unsigned threads = 1) const
+  {
+    threads = std::max(1u, threads);
+    partitioned<T> r;
+    cache_aligned_vector<T> tmp(n);
+    cache_aligned_vector<std::uint64_t> tmp_ds(n);
+    r.items.resize(n);
+    r.digests.resize(n);
+
+    // The first pass: each thread hashes, counts and scatters a chunk.
+    unsigned bits = pass_bits_[0];
+    unsigned shift = 64 - bits;
+    std::size_t chunk = (n + threads - 1) / threads;
+    std::size_t parts = n ? (n + chunk - 1) / chunk : 0;
+    std::vector<std::vector<std::size_t>> hists(parts, std::vector<std::size_t>(std::size_t(1) << bits));
+    radix_detail::run(parts, [&](std::size_t t) {
+      std::size_t lo = t * chunk, hi = std::min(n, lo + chunk);
+      hash_keys(in + lo, hi - lo, tmp_ds.data() + lo, key);
+      histogram(tmp_ds.data() + lo, hi - lo, shift, bits, hists[t].data());
+    });
+    r.bounds = parts ? prefix_sum(hists) : std::vector<std::size_t>((std::size_t(1) << bits) + 1, 0);
+    radix_detail::run(parts, [&](std::size_t t) {
+      std::size_t lo = t * chunk, hi = std::min(n, lo + chunk);
+      scatter(in + lo, tmp_ds.data() + lo, hi - lo, shift, bits, hists[t].data(),
+              r.items.data(), r.digests.data());
+    });
+
+    // Later passes: threads take partitions and refine each one.
+    for (std::size_t i = 1; i < pass_bits_.size(); ++i) {
+      r.items.swap(tmp);
+      r.digests.swap(tmp_ds);
+      bits = pass_bits_[i];
+      shift -= bits;
+      std::size_t fanout = std::size_t(1) << bits;
+      std::size_t count = r.partitions();
+      std::vector<std::size_t> bounds(count * fanout + 1);
+      bounds.back() = n;
+      std::atomic<std::size_t> next(0);
+      radix_detail::run(std::min<std::size_t>(threads, count), [&](std::size_t) {
+        std::vector<std::vector<std::size_t>> h(1, std::vector<std::size_t>(fanout));
+        for (std::size_t q; (q = next++) < count; ) {
+          std::size_t lo = r.bounds[q], hi = r.bounds[q + 1];
+          std::fill(h[0].begin(), h[0].end(), 0);
+          histogram(tmp_ds.data() + lo, hi - lo, shift, bits, h[0].data());
+          std::vector<std::size_t> b = prefix_sum(h, lo);
+          std::copy(b.begin(), b.end() - 1, bounds.begin() + q * fanout);
+          scatter(tmp.data() + lo, tmp_ds.data() + lo, hi - lo, shift, bits, h[0].data(),
+                  r.items.data(), r.digests.data());
+        }
+      });
+      r.bounds = std::move(bounds);
+    }
+    return r;
+  }
+
+  // Partition in[0, n) by the digests of the tuples themselves.
+  partitioned<T> partition(T const* in, std::size_t n, unsigned threads = 1) const
+  {
+    return partition(in, n, [](T const& t) -> T const& { return t; }, threads);
+  }
+
+  // Returns the number of bits of each pass.
+  std::vector<unsigned> const& passes() const { return pass_bits_; }
+
+private:
+  hash<H> hash_;
+  std::vector<unsigned> pass_bits_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,302 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_RENDEZVOUS_HASH_HPP
+#define ORIGIN_RENDEZVOUS_HASH_HPP
+
+// Weighted rendezvous (highest random weight) hashing [1, 2].
+//
+// A key is scored against every node, and goes to the node with the
+// best score. Removing a node only moves the keys on that node, and
+// adding one only moves keys to it. With weights, the score of node i
+// is w_i / -ln(u_i), where u_i is uniform in (0, 1) and derived from
+// the key and the node, so node i receives a share w_i / sum(w) of the
+// keys [2]. Equivalently, the node with the least -ln(u_i) / w_i wins.
+//
+// The key digest and node digests are combined with a cheap 32-bit
+// mix, and the logarithm is a short polynomial on the float exponent
+// and mantissa, so the scoring loop over nodes has no calls or
+// branches and vectorizes.
+//
+// For large clusters, the skeleton variant [3] arranges the nodes as
+// the leaves of a virtual tree with a small fanout f. A key descends
+// from the root by rendezvous among the children of each virtual node,
+// weighted by the total weight below each child, which costs
+// O(f log_f n) rather than O(n).
+//
+// [1] D. Thaler and C. Ravishankar. Using name-based mappings to
+// increase hit rates. IEEE/ACM Trans. Networking 6(1), 1998.
+//
+// [2] J. Resch. New hashing algorithms for data storage. 2015.
+//
+// [3] W. Wang and C. Ravishankar. Hash-based virtual hierarchies for
+// scalable location service in mobile ad-hoc networks. Mobile Networks
+// and Applications 14(5), 2009.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+namespace rendezvous_detail
+{
+
+// The finalizer of MurmurHash3, 32-bit version.
+inline std::uint32_t
+mix(std::uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return x;
+}
+
+
+// Returns -ln(u) for a uniform u in (0, 1) taken from the high 24 bits
+// of x. The absolute error is below 1e-6.
+inline float
+neg_log(std::uint32_t x)
+{
+  float u = float((x >> 8) | 1) * (1.0f / 16777216.0f);
+  std::uint32_t bits;
+  std::memcpy(&bits, &u, 4);
+  float e = float(int(bits >> 23) - 127);
+  bits = (bits & 0x007fffffu) | 0x3f800000u;
+  float m;
+  std::memcpy(&m, &bits, 4);
+  // ln(m) = 2 atanh(z), z = (m - 1) / (m + 1), for m in [1, 2).
+  float z = (m - 1) / (m + 1), z2 = z * z;
+  float s = z * (2 + z2 * (2.0f / 3 + z2 * (2.0f / 5 + z2 * (2.0f / 7 + z2 * (2.0f / 9)))));
+  return -(e * 0.69314718f + s);
+}
+
+
+// Score the m nodes of a block against the key digest k, and if the
+// least score is below least, update least and best (the index of the
+// first node with that score, offset by lo). If M is not 0, it is the
+// number of nodes, known at compile time. Scores are kept in an
+// array and the minimum and its first index are found with two
+// branch-free passes. Scores are never negative, so they order as
+// their bits do, and both passes are integer minimums.
+template<std::size_t M = 0>
+inline void
+scan(std::uint32_t k, std::uint32_t const* ids, float const* inv, std::size_t n,
+     std::size_t lo, std::uint32_t& least, std::size_t& best)
+{
+  constexpr std::size_t block = 64;
+  std::size_t const m = M ? M : n;
+  std::uint32_t s[block];
+  for (std::size_t i = 0; i < m; ++i) {
+    float x = neg_log(mix(k ^ ids[i])) * inv[i];
+    std::memcpy(&s[i], &x, 4);
+  }
+  std::uint32_t low = least;
+  for (std::size_t i = 0; i < m; ++i)
+    low = std::min(low, s[i]);
+  if (low < least) {
+    std::uint32_t first = block;
+    for (std::size_t i = 0; i < m; ++i)
+      first = std::min(first, s[i] == low ? std::uint32_t(i) : std::uint32_t(block));
+    least = low;
+    best = lo + first;
+  }
+}
+
+
+// Returns the index in [0, n) of the node with the least score for the
+// key digest k, where node i has digest ids[i] and inverse weight
+// inv[i], or n if every score is infinite. Full blocks of 64 nodes are
+// scanned with a fixed trip count, which lets the loops vectorize.
+inline std::size_t
+select(std::uint32_t k, std::uint32_t const* ids, float const* inv, std::size_t n)
+{
+  constexpr std::size_t block = 64;
+  std::uint32_t least = 0x7f800000; // Infinity
+  std::size_t best = n;
+  std::size_t lo = 0;
+  for (; lo + block <= n; lo += block)
+    scan<block>(k, ids + lo, inv + lo, block, lo, least, best);
+  if (lo < n)
+    scan(k, ids + lo, inv + lo, n - lo, lo, least, best);
+  return best;
+}
+
+
+inline float
+inverse(double w)
+{
+  if (!(w >= 0))
+    throw std::invalid_argument("rendezvous_hash: bad weight");
+  return w > 0 ? float(1 / w) : std::numeric_limits<float>::infinity();
+}
+
+} // namespace rendezvous_detail
+
+
+// -------------------------------------------------------------------------- //
+// Rendezvous hashing
+
+// Assigns keys to weighted nodes by scoring every node.
+template<Hash_algorithm_64 H = fnv1a>
+class rendezvous_hash
+{
+public:
+  explicit rendezvous_hash(std::uint64_t seed = 0)
+    : hash_(H(seed))
+  { }
+
+  // Add a node, or change its weight.
+  void insert(std::uint64_t id, double weight = 1)
+  {
+    float inv = rendezvous_detail::inverse(weight);
+    auto iter = std::find(nodes_.begin(), nodes_.end(), id);
+    if (iter != nodes_.end()) {
+      inv_[iter - nodes_.begin()] = inv;
+      return;
+    }
+    nodes_.push_back(id);
+    ids_.push_back(hash_mix(hash_(id)));
+    inv_.push_back(inv);
+  }
+
+  // Remove a node.
+  void erase(std::uint64_t id)
+  {
+    auto iter = std::find(nodes_.begin(), nodes_.end(), id);
+    if (iter == nodes_.end())
+      return;
+    std::size_t i = iter - nodes_.begin();
+    nodes_.erase(nodes_.begin() + i);
+    ids_.erase(ids_.begin() + i);
+    inv_.erase(inv_.begin() + i);
+  }
+
+  // Returns the id of the node for a key. There must be at least one
+  // node with a positive weight.
+  template<Hashable_with<H> T>
+  std::uint64_t operator()(T const& t) const
+  {
+    return nodes_[select_digest(hash_mix(hash_(t)))];
+  }
+
+  // Returns the index of the node for a digest.
+  std::size_t select_digest(std::uint64_t d) const
+  {
+    if (nodes_.empty())
+      throw std::logic_error("rendezvous_hash: no nodes");
+    std::uint32_t k = std::uint32_t(d) ^ std::uint32_t(d >> 32);
+    std::size_t i = rendezvous_detail::select(k, ids_.data(), inv_.data(), nodes_.size());
+    if (i == nodes_.size())
+      throw std::logic_error("rendezvous_hash: no node has a positive weight");
+    return i;
+  }
+
+  std::size_t size() const { return nodes_.size(); }
+
+private:
+  hash<H> hash_;
+  std::vector<std::uint64_t> nodes_;
+  std::vector<std::uint32_t> ids_;
+  std::vector<float> inv_;
+};
+
+
+// -------------------------------------------------------------------------- //
+// Skeleton-based rendezvous hashing
+
+// Assigns keys to weighted nodes through a virtual hierarchy.
+template<Hash_algorithm_64 H = fnv1a>
+class skeleton_rendezvous_hash
+{
+  // The nodes at one level of the hierarchy. Level 0 holds the real
+  // nodes, and node i at level l + 1 is the parent of nodes [i * f,
+  // (i + 1) * f) at level l.
+  struct level
+  {
+    std::vector<std::uint32_t> ids;
+    std::vector<double> weights;
+    std::vector<float> inv;
+  };
+
+public:
+  // Create a hierarchy over the nodes with the given ids and weights.
+  skeleton_rendezvous_hash(std::vector<std::uint64_t> const& nodes,
+                           std::vector<double> const& weights,
+                           std::size_t fanout = 8, std::uint64_t seed = 0)
+    : fanout_(fanout), hash_(H(seed)), nodes_(nodes)
+  {
+    if (nodes.empty() || nodes.size() != weights.size() || fanout < 2)
+      throw std::invalid_argument("skeleton_rendezvous_hash: bad nodes");
+    if (std::none_of(weights.begin(), weights.end(), [](double w) { return w > 0; }))
+      throw std::invalid_argument("skeleton_rendezvous_hash: no positive weight");
+    level leaves;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+      leaves.ids.push_back(hash_mix(hash_(nodes[i])));
+      leaves.weights.push_back(weights[i]);
+      leaves.inv.push_back(rendezvous_detail::inverse(weights[i]));
+    }
+    levels_.push_back(std::move(leaves));
+    while (levels_.back().ids.size() > fanout_) {
+      level const& below = levels_.back();
+      level up;
+      std::uint64_t depth = levels_.size();
+      for (std::size_t i = 0; i * fanout_ < below.ids.size(); ++i) {
+        std::size_t lo = i * fanout_, hi = std::min(below.ids.size(), lo + fanout_);
+        double w = 0;
+        for (std::size_t j = lo; j < hi; ++j)
+          w += below.weights[j];
+        up.ids.push_back(hash_mix(hash_(depth << 48 | i)));
+        up.weights.push_back(w);
+        up.inv.push_back(rendezvous_detail::inverse(w));
+      }
+      levels_.push_back(std::move(up));
+    }
+  }
+
+  // Returns the id of the node for a key.
+  template<Hashable_with<H> T>
+  std::uint64_t operator()(T const& t) const
+  {
+    return nodes_[select_digest(hash_mix(hash_(t)))];
+  }
+
+  // Returns the index of the node for a digest.
+  std::size_t select_digest(std::uint64_t d) const
+  {
+    std::uint32_t k = std::uint32_t(d) ^ std::uint32_t(d >> 32);
+    std::size_t l = levels_.size() - 1;
+    std::size_t lo = 0, hi = levels_[l].ids.size();
+    while (true) {
+      level const& v = levels_[l];
+      std::size_t i = lo + rendezvous_detail::select(k, &v.ids[lo], &v.inv[lo], hi - lo);
+      if (l == 0)
+        return i;
+      --l;
+      lo = i * fanout_;
+      hi = std::min(levels_[l].ids.size(), lo + fanout_);
+    }
+  }
+
+  std::size_t size() const { return nodes_.size(); }
+  std::size_t depth() const { return levels_.size(); }
+
+private:
+  std::size_t fanout_;
+  hash<H> hash_;
+  std::vector<std::uint64_t> nodes_;
+  std::vector<level> levels_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,160 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_SAMPLING_HPP
+#define ORIGIN_SAMPLING_HPP
+
+// Consistent hash-based sampling.
+//
+// A key is mapped to a point in [0, 1) by the top 53 bits of its mixed
+// digest, and is kept by a sample with rate r iff its point is below r.
+// The decision depends only on the key, the hash algorithm and the
+// seed, so independent services with the same seed select the same
+// keys without coordination. Samples with the same seed are nested: a
+// key in a sample of rate r is in every sample with a rate above r.
+//
+// A partition generalizes this to several consecutive ranges of
+// points, which splits keys into groups of given proportions (e.g., for
+// experiments). The first group of a partition is the sample with the
+// same rate.
+//
+// The batch filter computes the digests of a block of keys first, then
+// selects the kept keys with a branch-free loop.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace origin
+{
+
+template<Hash_algorithm_64 H = fnv1a>
+class consistent_sampler
+{
+  static constexpr double scale = 9007199254740992.0;  // 2^53
+
+public:
+  // Create a sampler that keeps a fraction rate of keys, 0 <= rate <= 1.
+  explicit consistent_sampler(double rate, std::uint64_t seed = 0)
+    : rate_(rate), seed_(seed), hash_(H(seed))
+  {
+    if (!(rate >= 0 && rate <= 1))
+      throw std::invalid_argument("consistent_sampler: bad rate");
+    limit_ = static_cast<std::uint64_t>(std::ceil(rate * scale));
+  }
+
+  // Returns the point of a key, in [0, 2^53).
+  template<Hashable_with<H> T>
+  std::uint64_t point(T const& t) const
+  {
+    return hash_mix(hash_(t)) >> 11;
+  }
+
+  // Returns true if the key is in the sample.
+  template<Hashable_with<H> T>
+  bool operator()(T const& t) const
+  {
+    return point(t) < limit_;
+  }
+
+  // Write the indexes of the sampled keys among keys[0, n) to out, and
+  // return their number. The output must have room for n indexes.
+  template<Hashable_with<H> T>
+  std::size_t filter(T const* keys, std::size_t n, std::size_t* out) const
+  {
+    constexpr std::size_t block = 256;
+    std::uint64_t ps[block];
+    std::size_t m = 0;
+    for (std::size_t lo = 0; lo < n; lo += block) {
+      std::size_t k = std::min(block, n - lo);
+      for (std::size_t i = 0; i < k; ++i)
+        ps[i] = point(keys[lo + i]);
+      for (std::size_t i = 0; i < k; ++i) {
+        out[m] = lo + i;
+        m += ps[i] < limit_;
+      }
+    }
+    return m;
+  }
+
+  // Returns the indexes of the sampled keys in keys[0, n).
+  template<Hashable_with<H> T>
+  std::vector<std::size_t> filter(T const* keys, std::size_t n) const
+  {
+    std::vector<std::size_t> out(n);
+    out.resize(filter(keys, n, out.data()));
+    return out;
+  }
+
+  // Returns a sampler with a lower rate whose sample is a subset of
+  // this one.
+  consistent_sampler subsample(double rate) const
+  {
+    if (rate > rate_)
+      throw std::invalid_argument("consistent_sampler: subsample rate too high");
+    return consistent_sampler(rate, seed_);
+  }
+
+  double rate() const { return rate_; }
+  std::uint64_t seed() const { return seed_; }
+
+private:
+  double rate_;
+  std::uint64_t seed_;
+  hash<H> hash_;
+  std::uint64_t limit_;
+};
+
+
+// Assigns keys consistently to groups in given proportions.
+template<Hash_algorithm_64 H = fnv1a>
+class consistent_partition
+{
+public:
+  // Create a partition whose group i receives a fraction weights[i] /
+  // sum(weights) of the keys.
+  explicit consistent_partition(std::vector<double> const& weights,
+                                std::uint64_t seed = 0)
+    : sampler_(1, seed)
+  {
+    double total = 0;
+    for (double w : weights) {
+      if (!(w >= 0))
+        throw std::invalid_argument("consistent_partition: bad weight");
+      total += w;
+    }
+    if (weights.empty() || !(total > 0))
+      throw std::invalid_argument("consistent_partition: bad weights");
+    double sum = 0;
+    for (std::size_t i = 0; i + 1 < weights.size(); ++i) {
+      sum += weights[i];
+      cuts_.push_back(static_cast<std::uint64_t>(std::ceil(sum / total * 9007199254740992.0)));
+    }
+  }
+
+  // Returns the group of a key.
+  template<Hashable_with<H> T>
+  std::size_t operator()(T const& t) const
+  {
+    std::uint64_t p = sampler_.point(t);
+    std::size_t g = 0;
+    for (std::uint64_t c : cuts_)
+      g += p >= c;
+    return g;
+  }
+
+  std::size_t groups() const { return cuts_.size() + 1; }
+
+private:
+  consistent_sampler<H> sampler_;
+  std::vector<std::uint64_t> cuts_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,162 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#include "shm_table.hpp"
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace origin
+{
+
+namespace
+{
+
+[[noreturn]] void
+throw_errno(char const* what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace
+
+
+shm_segment::shm_segment(shm_segment&& x) noexcept
+  : fd_(x.fd_), data_(x.data_), size_(x.size_)
+{
+  x.fd_ = -1;
+  x.data_ = nullptr;
+  x.size_ = 0;
+}
+
+
+shm_segment&
+shm_segment::operator=(shm_segment&& x) noexcept
+{
+  std::swap(fd_, x.fd_);
+  std::swap(data_, x.data_);
+  std::swap(size_, x.size_);
+  return *this;
+}
+
+
+shm_segment::~shm_segment()
+{
+  if (data_)
+    ::munmap(data_, size_);
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+
+shm_segment
+shm_segment::create(char const* name, std::size_t n)
+{
+  int fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    throw_errno("shm_open");
+  if (::ftruncate(fd, n) < 0) {
+    int err = errno;
+    ::close(fd);
+    ::shm_unlink(name);
+    errno = err;
+    throw_errno("ftruncate");
+  }
+  shm_segment s;
+  try {
+    s.map(fd);
+  } catch (...) {
+    ::shm_unlink(name);
+    throw;
+  }
+  return s;
+}
+
+
+shm_segment
+shm_segment::create_anonymous(std::size_t n)
+{
+  int fd = ::memfd_create("origin.shm", MFD_CLOEXEC);
+  if (fd < 0)
+    throw_errno("memfd_create");
+  if (::ftruncate(fd, n) < 0) {
+    int err = errno;
+    ::close(fd);
+    errno = err;
+    throw_errno("ftruncate");
+  }
+  shm_segment s;
+  s.map(fd);
+  return s;
+}
+
+
+shm_segment
+shm_segment::open(char const* name)
+{
+  int fd = ::shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+    throw_errno("shm_open");
+  shm_segment s;
+  s.map(fd);
+  return s;
+}
+
+
+shm_segment
+shm_segment::open(int fd)
+{
+  int dup = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup < 0)
+    throw_errno("fcntl");
+  shm_segment s;
+  s.map(dup);
+  return s;
+}
+
+
+void
+shm_segment::unlink(char const* name)
+{
+  if (::shm_unlink(name) < 0)
+    throw_errno("shm_unlink");
+}
+
+
+// Map the entire object referred to by fd, taking ownership of fd.
+void
+shm_segment::map(int fd)
+{
+  fd_ = fd;
+  struct stat st;
+  if (::fstat(fd, &st) < 0)
+    throw_errno("fstat");
+  size_ = st.st_size;
+  void* p = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    throw_errno("mmap");
+  data_ = p;
+}
+
+
+void
+init_shared_lock(pthread_rwlock_t* l)
+{
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  int err = pthread_rwlock_init(l, &attr);
+  pthread_rwlockattr_destroy(&attr);
+  if (err)
+    throw std::system_error(err, std::generic_category(), "pthread_rwlock_init");
+}
+
+
+} // namespace origin
@@ -0,0 +1,374 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_SHM_TABLE_HPP
+#define ORIGIN_SHM_TABLE_HPP
+
+// A hash table that lives in a POSIX shared memory segment. The table
+// is created once per host and mapped by any number of processes, so
+// large lookup tables are not duplicated per worker.
+//
+// The segment is laid out as a header followed by an array of slots.
+// Nothing in the segment stores an absolute address: the header refers
+// to the slot array through a self-relative offset pointer, so each
+// process may map the segment at a different address. For the same
+// reason, keys and values must be trivially copyable and must not be
+// pointers.
+//
+// The hash seed is stored in the header, so every process computes the
+// same digests for the same keys. Readers and the (single) writer are
+// synchronized by a process-shared reader-writer lock.
+
+#include "hashing.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <pthread.h>
+
+
+namespace origin
+{
+
+// -------------------------------------------------------------------------- //
+// Offset pointers
+
+// An offset pointer refers to an object in the same memory mapping by
+// storing the distance from its own address. It remains valid when the
+// mapping is placed at a different address in another process.
+template<typename T>
+struct offset_ptr
+{
+  offset_ptr() = default;
+  offset_ptr(offset_ptr const&) = delete;
+  offset_ptr& operator=(offset_ptr const&) = delete;
+
+  offset_ptr& operator=(T* p) noexcept
+  {
+    off_ = p ? reinterpret_cast<byte const*>(p) - self() : 0;
+    return *this;
+  }
+
+  T* get() const noexcept
+  {
+    return off_ ? reinterpret_cast<T*>(const_cast<byte*>(self()) + off_) : nullptr;
+  }
+
+  T* operator->() const noexcept { return get(); }
+  T& operator[](std::size_t n) const noexcept { return get()[n]; }
+
+  byte const* self() const noexcept
+  {
+    return reinterpret_cast<byte const*>(this);
+  }
+
+  std::ptrdiff_t off_ = 0;
+};
+
+
+// -------------------------------------------------------------------------- //
+// Shared memory segments
+
+// A shared memory segment is a mapped POSIX shared memory object. A
+// segment is either named (shm_open) or anonymous (memfd_create). An
+// anonymous segment is shared by passing its file descriptor to other
+// processes, e.g., by inheriting it across fork().
+class shm_segment
+{
+public:
+  shm_segment() = default;
+  shm_segment(shm_segment&&) noexcept;
+  shm_segment& operator=(shm_segment&&) noexcept;
+  ~shm_segment();
+
+  // Create a new named segment of n bytes. Fails if the name exists.
+  static shm_segment create(char const* name, std::size_t n);
+
+  // Create a new anonymous segment of n bytes.
+  static shm_segment create_anonymous(std::size_t n);
+
+  // Map an existing named segment.
+  static shm_segment open(char const* name);
+
+  // Map an existing segment from a file descriptor. The descriptor is
+  // duplicated, so the caller retains ownership of fd.
+  static shm_segment open(int fd);
+
+  // Remove the name of a segment. Existing mappings remain valid.
+  static void unlink(char const* name);
+
+  void* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  int fd() const { return fd_; }
+
+private:
+  void map(int fd);
+
+  int fd_ = -1;
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+
+// Initialize a process-shared reader-writer lock in place.
+void init_shared_lock(pthread_rwlock_t*);
+
+
+// The RAII guards for reader and writer access.
+struct shm_read_lock
+{
+  explicit shm_read_lock(pthread_rwlock_t* l) : l_(l) { pthread_rwlock_rdlock(l_); }
+  ~shm_read_lock() { pthread_rwlock_unlock(l_); }
+  pthread_rwlock_t* l_;
+};
+
+struct shm_write_lock
+{
+  explicit shm_write_lock(pthread_rwlock_t* l) : l_(l) { pthread_rwlock_wrlock(l_); }
+  ~shm_write_lock() { pthread_rwlock_unlock(l_); }
+  pthread_rwlock_t* l_;
+};
+
+
+// -------------------------------------------------------------------------- //
+// Shared memory hash table
+
+// A fixed-capacity, open-addressing (linear probing) hash table stored
+// in a shared memory segment. The capacity is chosen at creation and
+// rounded up to a power of 2. Erasure uses backward-shift deletion, so
+// no tombstones accumulate.
+//
+// Lookups take the shared lock and may run concurrently in any number
+// of processes. Modifications take the exclusive lock. The lock is a
+// process-shared rwlock, which cannot be made robust: if a process dies
+// while holding it, other processes that take it block forever, and
+// the table must be recreated.
+template<Trivially_comparable K, typename V, Hash_algorithm_64 H = fnv1a>
+class shm_table
+{
+  static_assert(std::is_trivially_copyable<V>::value,
+                "shared memory values must be trivially copyable");
+  static_assert(!std::is_pointer<K>::value && !std::is_pointer<V>::value,
+                "shared memory keys and values must not be pointers");
+
+  static constexpr std::uint64_t magic = 0x6f726967696e4854ull; // "originHT"
+
+  struct slot
+  {
+    std::uint8_t used;
+    K key;
+    V value;
+  };
+
+  struct header
+  {
+    std::uint64_t magic;
+    std::uint64_t seed;
+    std::uint64_t key_size;
+    std::uint64_t value_size;
+    std::uint64_t capacity;
+    std::uint64_t size;
+    pthread_rwlock_t lock;
+    offset_ptr<slot> slots;
+  };
+
+public:
+  // Create a named table with room for at least n entries.
+  static shm_table create(char const* name, std::size_t n, std::uint64_t seed)
+  {
+    std::size_t cap = capacity_for(n);
+    shm_table t(shm_segment::create(name, bytes_for(cap)));
+    try {
+      t.init(cap, seed);
+    } catch (...) {
+      shm_segment::unlink(name);
+      throw;
+    }
+    return t;
+  }
+
+  // Create an anonymous table with room for at least n entries.
+  static shm_table create_anonymous(std::size_t n, std::uint64_t seed)
+  {
+    std::size_t cap = capacity_for(n);
+    shm_table t(shm_segment::create_anonymous(bytes_for(cap)));
+    t.init(cap, seed);
+    return t;
+  }
+
+  // Attach to an existing named table.
+  static shm_table open(char const* name)
+  {
+    shm_table t(shm_segment::open(name));
+    t.check();
+    return t;
+  }
+
+  // Attach to an existing table through a file descriptor.
+  static shm_table open(int fd)
+  {
+    shm_table t(shm_segment::open(fd));
+    t.check();
+    return t;
+  }
+
+  // Remove the name of a table. Processes that have it mapped keep it
+  // until they unmap it.
+  static void unlink(char const* name)
+  {
+    shm_segment::unlink(name);
+  }
+
+  // Insert or assign the value for k. Returns false if the key is new
+  // and the table is full.
+  bool insert(K const& k, V const& v)
+  {
+    shm_write_lock lock(&hdr()->lock);
+    header* h = hdr();
+    slot* s = h->slots.get();
+    std::size_t mask = h->capacity - 1;
+    for (std::size_t i = index(k); ; i = (i + 1) & mask) {
+      if (!s[i].used) {
+        if (h->size == h->capacity - 1)
+          return false;
+        s[i].used = 1;
+        s[i].key = k;
+        s[i].value = v;
+        ++h->size;
+        return true;
+      }
+      if (s[i].key == k) {
+        s[i].value = v;
+        return true;
+      }
+    }
+  }
+
+  // Copy the value for k into v. Returns false if k is not present.
+  bool find(K const& k, V& v) const
+  {
+    shm_read_lock lock(&hdr()->lock);
+    header const* h = hdr();
+    slot const* s = h->slots.get();
+    std::size_t mask = h->capacity - 1;
+    for (std::size_t i = index(k); s[i].used; i = (i + 1) & mask) {
+      if (s[i].key == k) {
+        v = s[i].value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Remove k from the table. Returns false if k was not present.
+  bool erase(K const& k)
+  {
+    shm_write_lock lock(&hdr()->lock);
+    header* h = hdr();
+    slot* s = h->slots.get();
+    std::size_t mask = h->capacity - 1;
+    std::size_t i = index(k);
+    for (; s[i].used; i = (i + 1) & mask)
+      if (s[i].key == k)
+        break;
+    if (!s[i].used)
+      return false;
+
+    // Shift back later entries whose probe sequence passes through i.
+    std::size_t j = i;
+    while (true) {
+      j = (j + 1) & mask;
+      if (!s[j].used)
+        break;
+      std::size_t home = index(s[j].key);
+      if (((j - home) & mask) >= ((j - i) & mask)) {
+        s[i] = s[j];
+        i = j;
+      }
+    }
+    s[i].used = 0;
+    --h->size;
+    return true;
+  }
+
+  std::size_t size() const
+  {
+    shm_read_lock lock(&hdr()->lock);
+    return hdr()->size;
+  }
+
+  std::size_t capacity() const { return hdr()->capacity; }
+  std::uint64_t seed() const { return hdr()->seed; }
+  shm_segment const& segment() const { return seg_; }
+
+private:
+  explicit shm_table(shm_segment&& s)
+    : seg_(std::move(s))
+  { }
+
+  static std::size_t capacity_for(std::size_t n)
+  {
+    std::size_t cap = 16;
+    while (cap - cap / 8 < n)
+      cap *= 2;
+    return cap;
+  }
+
+  static std::size_t bytes_for(std::size_t cap)
+  {
+    return slots_offset() + cap * sizeof(slot);
+  }
+
+  static constexpr std::size_t slots_offset()
+  {
+    return (sizeof(header) + alignof(slot) - 1) / alignof(slot) * alignof(slot);
+  }
+
+  header* hdr() const
+  {
+    return static_cast<header*>(seg_.data());
+  }
+
+  void init(std::size_t cap, std::uint64_t seed)
+  {
+    header* h = hdr();
+    h->seed = seed;
+    h->key_size = sizeof(K);
+    h->value_size = sizeof(V);
+    h->capacity = cap;
+    h->size = 0;
+    init_shared_lock(&h->lock);
+    h->slots = reinterpret_cast<slot*>(static_cast<byte*>(seg_.data()) + slots_offset());
+    hash_ = hash<H>(H(seed));
+    // Publish the magic number last; a segment without it is unusable.
+    // The release store orders the header before it.
+    __atomic_store_n(&h->magic, magic, __ATOMIC_RELEASE);
+  }
+
+  void check()
+  {
+    header const* h = hdr();
+    if (seg_.size() < sizeof(header) || __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != magic)
+      throw std::runtime_error("shm_table: not a hash table segment");
+    if (h->key_size != sizeof(K) || h->value_size != sizeof(V))
+      throw std::runtime_error("shm_table: key or value type mismatch");
+    if (seg_.size() < bytes_for(h->capacity))
+      throw std::runtime_error("shm_table: truncated segment");
+    hash_ = hash<H>(H(h->seed));
+  }
+
+  std::size_t index(K const& k) const
+  {
+    return hash_mix(hash_(k)) & (hdr()->capacity - 1);
+  }
+
+  shm_segment seg_;
+  hash<H> hash_;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,234 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_SIMHASH_HPP
+#define ORIGIN_SIMHASH_HPP
+
+// 64-bit SimHash fingerprints [1] and an index for finding fingerprints
+// within a small Hamming distance [2].
+//
+// A fingerprint is built from weighted features. Each feature is hashed
+// with hash_append, and each of the 64 counters is raised by the weight
+// if the corresponding bit of the digest is set, and lowered otherwise.
+// Bit i of the fingerprint is set iff counter i is positive. Similar
+// documents have fingerprints that differ in few bits.
+//
+// The index splits the fingerprint into m blocks. If two fingerprints
+// differ in at most k bits, then at least m - k of the blocks are equal.
+// So, for each choice of m - k blocks, the index keeps a table of the
+// fingerprints with those blocks permuted to the high bits, sorted. A
+// query is an equal-range search of each table on the high bits
+// followed by a Hamming distance check. There are C(m, k) tables.
+//
+// [1] M. Charikar. Similarity estimation techniques from rounding
+// algorithms. STOC 2002.
+//
+// [2] G. Manku, A. Jain and A. Das Sarma. Detecting near-duplicates for
+// web crawling. WWW 2007.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+
+namespace origin
+{
+
+// Returns the number of bits in which two fingerprints differ.
+inline int
+hamming_distance(std::uint64_t a, std::uint64_t b)
+{
+  return __builtin_popcountll(a ^ b);
+}
+
+
+// Accumulates weighted features into a SimHash fingerprint.
+template<Hash_algorithm_64 H = fnv1a>
+class simhash
+{
+public:
+  explicit simhash(std::uint64_t seed = 0)
+    : hash_(H(seed))
+  {
+    clear();
+  }
+
+  // Add a feature with the given weight.
+  template<Hashable_with<H> T>
+  void insert(T const& t, float w = 1)
+  {
+    insert_digest(hash_mix(hash_(t)), w);
+  }
+
+  // Add each feature in [first, last) with unit weight.
+  template<Forward_iterator I>
+    requires Hashable_type<H, Value_type<I>>()
+  void insert(I first, I last)
+  {
+    for (; first != last; ++first)
+      insert_digest(hash_mix(hash_(*first)), 1);
+  }
+
+  // Add a feature digest. The loop has no dependencies between lanes,
+  // and vectorizes.
+  void insert_digest(std::uint64_t d, float w)
+  {
+    for (int i = 0; i < 64; ++i)
+      acc_[i] += ((d >> i) & 1) ? w : -w;
+  }
+
+  // Returns the fingerprint of the features added so far.
+  std::uint64_t value() const
+  {
+    std::uint64_t fp = 0;
+    for (int i = 0; i < 64; ++i)
+      fp |= std::uint64_t(acc_[i] > 0) << i;
+    return fp;
+  }
+
+  void clear()
+  {
+    std::fill(acc_, acc_ + 64, 0.0f);
+  }
+
+private:
+  hash<H> hash_;
+  float acc_[64];
+};
+
+
+// Finds fingerprints within Hamming distance k of a query.
+class simhash_index
+{
+  struct entry
+  {
+    std::uint64_t key;  // The permuted fingerprint.
+    std::uint64_t id;
+
+    bool operator<(entry const& x) const { return key < x.key; }
+  };
+
+  struct table
+  {
+    int order[8];       // The blocks, high to low.
+    std::vector<entry> entries;
+  };
+
+public:
+  // An index for distances up to k <= 3 using m blocks, where k < m
+  // and 2 <= m <= 8. The default, m = k + 2, uses C(k + 2, 2) tables
+  // whose keys are about 2/(k + 2) of the fingerprint.
+  explicit simhash_index(int k, int m = 0)
+    : k_(k), m_(m ? m : k + 2)
+  {
+    if (k < 0 || k > 3 || m_ <= k || m_ < 2 || m_ > 8)
+      throw std::invalid_argument("simhash_index: bad distance or blocks");
+    for (int j = 0; j <= m_; ++j)
+      start_[j] = j * 64 / m_;
+    // Each table puts a choice of m - k blocks first, in increasing
+    // order, followed by the rest.
+    for (unsigned s = 0; s < (1u << m_); ++s) {
+      if (__builtin_popcount(s) != m_ - k_)
+        continue;
+      table t;
+      int n = 0;
+      for (int j = 0; j < m_; ++j)
+        if (s & (1u << j))
+          t.order[n++] = j;
+      for (int j = 0; j < m_; ++j)
+        if (!(s & (1u << j)))
+          t.order[n++] = j;
+      tables_.push_back(t);
+    }
+    prefix_.resize(tables_.size());
+    for (std::size_t i = 0; i < tables_.size(); ++i) {
+      int bits = 0;
+      for (int j = 0; j < m_ - k_; ++j)
+        bits += width(tables_[i].order[j]);
+      prefix_[i] = bits;
+    }
+  }
+
+  // Add a fingerprint with an id. The index must be rebuilt before the
+  // next query.
+  void insert(std::uint64_t fp, std::uint64_t id)
+  {
+    for (table& t : tables_)
+      t.entries.push_back({permute(t, fp), id});
+    built_ = false;
+  }
+
+  // Sort the tables, using up to the given number of threads.
+  void build(unsigned threads = 1)
+  {
+    threads = std::max(1u, threads);
+    std::vector<std::thread> ts;
+    auto work = [this, threads](unsigned w) {
+      for (std::size_t i = w; i < tables_.size(); i += threads)
+        std::sort(tables_[i].entries.begin(), tables_[i].entries.end());
+    };
+    for (unsigned w = 1; w < threads; ++w)
+      ts.emplace_back(work, w);
+    work(0);
+    for (std::thread& t : ts)
+      t.join();
+    built_ = true;
+  }
+
+  // Returns the ids of the fingerprints within distance k of fp, in
+  // increasing order and without duplicates.
+  std::vector<std::uint64_t> query(std::uint64_t fp) const
+  {
+    if (!built_)
+      throw std::logic_error("simhash_index: query before build");
+    std::vector<std::uint64_t> out;
+    for (std::size_t i = 0; i < tables_.size(); ++i) {
+      table const& t = tables_[i];
+      std::uint64_t key = permute(t, fp);
+      int shift = 64 - prefix_[i];
+      std::uint64_t lo = key >> shift << shift;
+      std::uint64_t hi = shift ? lo | (~std::uint64_t(0) >> prefix_[i]) : lo;
+      auto first = std::lower_bound(t.entries.begin(), t.entries.end(), entry{lo, 0});
+      for (; first != t.entries.end() && first->key <= hi; ++first)
+        if (hamming_distance(first->key, key) <= k_)
+          out.push_back(first->id);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+  }
+
+  std::size_t size() const { return tables_[0].entries.size(); }
+  std::size_t tables() const { return tables_.size(); }
+
+private:
+  int width(int j) const { return start_[j + 1] - start_[j]; }
+
+  // Returns the bits of fp with the blocks in the table's order.
+  // Permuting bits preserves Hamming distance.
+  std::uint64_t permute(table const& t, std::uint64_t fp) const
+  {
+    std::uint64_t out = 0;
+    for (int i = 0; i < m_; ++i) {
+      int j = t.order[i], w = width(j);
+      std::uint64_t block = (fp >> start_[j]) & (~std::uint64_t(0) >> (64 - w));
+      out = out << w | block;
+    }
+    return out;
+  }
+
+  int k_;
+  int m_;
+  int start_[9];
+  std::vector<table> tables_;
+  std::vector<int> prefix_;
+  bool built_ = true;
+};
+
+
+} // namespace origin
+
+
+#endif
@@ -0,0 +1,279 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_SPACE_SAVING_HPP
+#define ORIGIN_SPACE_SAVING_HPP
+
+// The SpaceSaving algorithm [1] for the top-k heavy hitters of a
+// stream, using the Stream-Summary structure for O(1) updates.
+//
+// The summary monitors at most k keys. Counters are found through a
+// hash table keyed by origin::hash<H>. Counters with equal counts share
+// a bucket, and buckets form a list ordered by count, so incrementing a
+// counter moves it to the next bucket and the minimum counter is always
+// at the head of the list. An unmonitored key replaces a counter with
+// the minimum count m, and is recorded with count m + 1 and error m.
+//
+// For every monitored key, count - error <= true count <= count. Any
+// key whose true count exceeds N / k is monitored.
+//
+// Summaries from different threads or shards can be merged [2]. The
+// merged summary has the same guarantees for the combined stream.
+//
+// [1] A. Metwally et al. Efficient computation of frequent and top-k
+// elements in data streams. ICDT 2005.
+//
+// [2] P. Agarwal et al. Mergeable summaries. PODS 2012.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+
+namespace origin
+{
+
+template<typename K, Hash_algorithm_64 H = fnv1a>
+  requires Hashable_with<K, H>()
+class space_saving
+{
+  static constexpr std::uint32_t none = -1;
+
+  struct counter
+  {
+    K key;
+    std::uint64_t error;
+    std::uint32_t bucket;
+    std::uint32_t prev, next;  // Siblings in the bucket.
+  };
+
+  struct bucket
+  {
+    std::uint64_t count;
+    std::uint32_t first;       // The first counter.
+    std::uint32_t prev, next;  // Adjacent buckets, by count.
+  };
+
+public:
+  // An estimated frequency: count - error <= true count <= count.
+  struct item
+  {
+    K key;
+    std::uint64_t count;
+    std::uint64_t error;
+  };
+
+  // Create a summary with k counters.
+  explicit space_saving(std::size_t k, std::uint64_t seed = 0)
+    : capacity_(k), index_(2 * k, hash<H>(H(seed)))
+  {
+    if (k == 0 || k >= none)
+      throw std::invalid_argument("space_saving: bad capacity");
+    counters_.reserve(k);
+  }
+
+  // Add w occurrences of key.
+  void insert(K const& key, std::uint64_t w = 1)
+  {
+    total_ += w;
+    auto iter = index_.find(key);
+    if (iter != index_.end()) {
+      increment(iter->second, w);
+      return;
+    }
+
+    if (counters_.size() < capacity_) {
+      std::uint32_t c = counters_.size();
+      counters_.push_back({key, 0, none, none, none});
+      index_.emplace(key, c);
+      place(c, none, w);
+      return;
+    }
+
+    // Replace a counter with the minimum count.
+    std::uint32_t c = buckets_[head_].first;
+    counter& x = counters_[c];
+    std::uint64_t m = buckets_[head_].count;
+    index_.erase(x.key);
+    x.key = key;
+    x.error = m;
+    index_.emplace(key, c);
+    increment(c, w);
+  }
+
+  // Returns the estimate for key, or a zero count if it is not
+  // monitored. If the summary is full, an unmonitored key occurs at
+  // most min_count() times.
+  item find(K const& key) const
+  {
+    auto iter = index_.find(key);
+    if (iter == index_.end())
+      return {key, 0, 0};
+    counter const& c = counters_[iter->second];
+    return {key, buckets_[c.bucket].count, c.error};
+  }
+
+  // Returns up to n monitored keys in decreasing order of count.
+  std::vector<item> top(std::size_t n) const
+  {
+    std::vector<item> out;
+    for (std::uint32_t b = tail_; b != none && out.size() < n; b = buckets_[b].prev)
+      for (std::uint32_t c = buckets_[b].first; c != none && out.size() < n; c = counters_[c].next)
+        out.push_back({counters_[c].key, buckets_[b].count, counters_[c].error});
+    return out;
+  }
+
+  // Returns the smallest monitored count, or 0 if the summary is not
+  // full.
+  std::uint64_t min_count() const
+  {
+    return counters_.size() < capacity_ ? 0 : buckets_[head_].count;
+  }
+
+  // Merge another summary into this one. A key missing from one
+  // summary is credited with that summary's minimum count, as both
+  // count and error. The k largest counts are kept.
+  void merge(space_saving const& x)
+  {
+    std::uint64_t m1 = min_count(), m2 = x.min_count();
+    std::unordered_map<K, item, hash<H>> all(2 * (size() + x.size()), index_.hash_function());
+    for (item const& i : top(size()))
+      all.emplace(i.key, item{i.key, i.count + m2, i.error + m2});
+    for (item const& i : x.top(x.size())) {
+      auto ins = all.emplace(i.key, item{i.key, i.count + m1, i.error + m1});
+      if (!ins.second) {
+        ins.first->second.count += i.count - m2;
+        ins.first->second.error += i.error - m2;
+      }
+    }
+
+    std::vector<item> items;
+    items.reserve(all.size());
+    for (auto& kv : all)
+      items.push_back(kv.second);
+    std::size_t n = std::min(items.size(), capacity_);
+    std::partial_sort(items.begin(), items.begin() + n, items.end(),
+                      [](item const& a, item const& b) { return a.count > b.count; });
+
+    std::uint64_t total = total_ + x.total_;
+    clear();
+    total_ = total;
+    // Insert in increasing order of count so each counter is placed at
+    // the tail of the bucket list, joining the tail bucket on a tie.
+    for (std::size_t i = n; i-- > 0; ) {
+      std::uint32_t c = counters_.size();
+      counters_.push_back({items[i].key, items[i].error, none, none, none});
+      index_.emplace(items[i].key, c);
+      place(c, tail_ != none ? buckets_[tail_].prev : none, items[i].count);
+    }
+  }
+
+  void clear()
+  {
+    counters_.clear();
+    buckets_.clear();
+    free_.clear();
+    index_.clear();
+    head_ = tail_ = none;
+    total_ = 0;
+  }
+
+  std::size_t size() const { return counters_.size(); }
+  std::size_t capacity() const { return capacity_; }
+
+  // Returns the number of buckets, one for each distinct count.
+  std::size_t bucket_count() const { return buckets_.size() - free_.size(); }
+
+  // Returns the total weight inserted.
+  std::uint64_t total() const { return total_; }
+
+private:
+  // Remove counter c from its bucket, freeing the bucket if it becomes
+  // empty. Returns the bucket before it.
+  std::uint32_t unlink(std::uint32_t c)
+  {
+    counter& x = counters_[c];
+    bucket& b = buckets_[x.bucket];
+    std::uint32_t before = b.prev;
+    if (x.prev != none)
+      counters_[x.prev].next = x.next;
+    else
+      b.first = x.next;
+    if (x.next != none)
+      counters_[x.next].prev = x.prev;
+    if (b.first == none) {
+      (b.prev != none ? buckets_[b.prev].next : head_) = b.next;
+      (b.next != none ? buckets_[b.next].prev : tail_) = b.prev;
+      free_.push_back(x.bucket);
+    } else {
+      before = x.bucket;
+    }
+    x.bucket = none;
+    return before;
+  }
+
+  // Place counter c in the bucket with the given count, searching
+  // forward from the bucket after b (or from the head if b is none).
+  void place(std::uint32_t c, std::uint32_t b, std::uint64_t count)
+  {
+    std::uint32_t next = b == none ? head_ : buckets_[b].next;
+    while (next != none && buckets_[next].count < count) {
+      b = next;
+      next = buckets_[next].next;
+    }
+    std::uint32_t target;
+    if (next != none && buckets_[next].count == count) {
+      target = next;
+    } else {
+      target = new_bucket(count);
+      bucket& t = buckets_[target];
+      t.prev = b;
+      t.next = next;
+      (b != none ? buckets_[b].next : head_) = target;
+      (next != none ? buckets_[next].prev : tail_) = target;
+    }
+    counter& x = counters_[c];
+    bucket& t = buckets_[target];
+    x.bucket = target;
+    x.prev = none;
+    x.next = t.first;
+    if (t.first != none)
+      counters_[t.first].prev = c;
+    t.first = c;
+  }
+
+  void increment(std::uint32_t c, std::uint64_t w)
+  {
+    std::uint64_t count = buckets_[counters_[c].bucket].count + w;
+    place(c, unlink(c), count);
+  }
+
+  std::uint32_t new_bucket(std::uint64_t count)
+  {
+    if (!free_.empty()) {
+      std::uint32_t b = free_.back();
+      free_.pop_back();
+      buckets_[b] = {count, none, none, none};
+      return b;
+    }
+    buckets_.push_back({count, none, none, none});
+    return buckets_.size() - 1;
+  }
+
+  std::size_t capacity_;
+  std::vector<counter> counters_;
+  std::vector<bucket> buckets_;
+  std::vector<std::uint32_t> free_;
+  std::uint32_t head_ = none;
+  std::uint32_t tail_ = none;
+  std::uint64_t total_ = 0;
+  std::unordered_map<K, std::uint32_t, hash<H>> index_;
+};
+
+
+} // namespace origin
+
+
+#endif
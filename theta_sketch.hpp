@@ -0,0 +1,407 @@
+// Copyright (c) 2016 Andrew Sutton
+// All rights reserved
+
+#ifndef ORIGIN_THETA_SKETCH_HPP
+#define ORIGIN_THETA_SKETCH_HPP
+
+// Theta sketches [1] for distinct counts that support set operations.
+//
+// A sketch keeps the distinct 64-bit digests below a threshold theta,
+// which is lowered so that about k digests are retained (a KMV sketch
+// [2]). Digests are uniform, so the number of distinct objects is
+// estimated as the number retained divided by theta / 2^64. Until k
+// distinct objects are seen, theta is 2^64 and the count is exact.
+//
+// Updates use an open-addressed table of the retained digests, which
+// is allowed to hold up to 2k before theta is lowered to the k-th
+// smallest digest by quickselect (the QuickSelect sketch of [1]).
+//
+// A sketch is compacted to a sorted list of digests and its theta.
+// Set operations on compact sketches take the smaller theta and the
+// union, intersection or difference of the digests below it, and the
+// result estimates the size of the corresponding set of objects.
+// Sketches to be combined must use the same hash algorithm and seed.
+//
+// [1] A. Dasgupta et al. A framework for estimating stream expression
+// cardinalities. ICDT 2016.
+//
+// [2] K. Beyer et al. On synopses for distinct-value estimation under
+// multiset operations. SIGMOD 2007.
+
+#include "hashing.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+
+namespace origin
+{
+
+// -------------------------------------------------------------------------- //
+// Compact sketches
+
+// An immutable theta sketch: the sorted digests below theta.
+struct compact_theta_sketch
+{
+  static constexpr std::uint64_t max_theta = std::numeric_limits<std::uint64_t>::max();
+  static constexpr byte format_version = 1;
+
+  std::uint64_t seed = 0;
+  std::uint64_t theta = max_theta;
+  std::vector<std::uint64_t> entries;
+
+  // Returns true if the sketch is exact (theta has never been lowered).
+  bool exact() const { return theta == max_theta; }
+
+  // Returns the estimated number of distinct objects.
+  double estimate() const
+  {
+    if (exact())
+      return entries.size();
+    return entries.size() / (double(theta) / 18446744073709551616.0);
+  }
+
+  // Serialization format:
+  //
+  //    u8 version, u64 seed, u64 theta (little-endian)
+  //    varint count, then varint deltas of the sorted digests
+  std::vector<byte> serialize() const
+  {
+    std::vector<byte> out {format_version};
+    put_word(out, seed);
+    put_word(out, theta);
+    put_varint(out, entries.size());
+    std::uint64_t prev = 0;
+    for (std::uint64_t e : entries) {
+      put_varint(out, e - prev);
+      prev = e;
+    }
+    return out;
+  }
+
+  static compact_theta_sketch deserialize(byte const* p, std::size_t n)
+  {
+    byte const* end = p + n;
+    if (n < 17 || p[0] != format_version)
+      throw std::runtime_error("theta_sketch: bad serialization");
+    ++p;
+    compact_theta_sketch s;
+    s.seed = get_word(p);
+    s.theta = get_word(p);
+    std::uint64_t count = get_varint(p, end);
+    if (count > std::size_t(end - p))
+      throw std::runtime_error("theta_sketch: truncated serialization");
+    s.entries.reserve(count);
+    std::uint64_t prev = 0;
+    for (std::uint64_t i = 0; i < count; ++i) {
+      prev += get_varint(p, end);
+      if (prev >= s.theta || (i && prev <= s.entries.back()))
+        throw std::runtime_error("theta_sketch: bad serialization");
+      s.entries.push_back(prev);
+    }
+    return s;
+  }
+
+private:
+  static void put_word(std::vector<byte>& out, std::uint64_t w)
+  {
+    for (unsigned i = 0; i < 8; ++i)
+      out.push_back(byte(w >> (8 * i)));
+  }
+
+  static std::uint64_t get_word(byte const*& p)
+  {
+    std::uint64_t w = 0;
+    for (unsigned i = 0; i < 8; ++i)
+      w |= std::uint64_t(*p++) << (8 * i);
+    return w;
+  }
+
+  static void put_varint(std::vector<byte>& out, std::uint64_t x)
+  {
+    for (; x >= 0x80; x >>= 7)
+      out.push_back(byte(x | 0x80));
+    out.push_back(byte(x));
+  }
+
+  static std::uint64_t get_varint(byte const*& p, byte const* end)
+  {
+    std::uint64_t x = 0;
+    for (unsigned s = 0; p != end && s < 64; s += 7) {
+      byte b = *p++;
+      x |= std::uint64_t(b & 0x7f) << s;
+      if (!(b & 0x80))
+        return x;
+    }
+    throw std::runtime_error("theta_sketch: truncated serialization");
+  }
+};
+
+
+namespace theta_detail
+{
+
+inline void
+check(compact_theta_sketch const& a, compact_theta_sketch const& b)
+{
+  if (a.seed != b.seed)
+    throw std::invalid_argument("theta_sketch: incompatible seeds");
+}
+
+// Keep the k smallest entries, lowering theta to the (k+1)-th.
+inline void
+trim(compact_theta_sketch& s, std::size_t k)
+{
+  if (s.entries.size() > k) {
+    s.theta = s.entries[k];
+    s.entries.resize(k);
+  }
+}
+
+} // namespace theta_detail
+
+
+// Returns a sketch of the union of the sets sketched by a and b,
+// retaining at most k digests.
+inline compact_theta_sketch
+theta_union(compact_theta_sketch const& a, compact_theta_sketch const& b,
+            std::size_t k)
+{
+  theta_detail::check(a, b);
+  compact_theta_sketch r;
+  r.seed = a.seed;
+  r.theta = std::min(a.theta, b.theta);
+  auto ae = std::lower_bound(a.entries.begin(), a.entries.end(), r.theta);
+  auto be = std::lower_bound(b.entries.begin(), b.entries.end(), r.theta);
+  std::set_union(a.entries.begin(), ae, b.entries.begin(), be,
+                 std::back_inserter(r.entries));
+  theta_detail::trim(r, k);
+  return r;
+}
+
+
+// Returns a sketch of the union of all the sketches in xs, retaining at
+// most k digests. Pairs are merged in parallel, in a tree, using up to
+// the given number of threads.
+inline compact_theta_sketch
+theta_union(std::vector<compact_theta_sketch> xs, std::size_t k,
+            unsigned threads = 1)
+{
+  if (xs.empty())
+    return {};
+  threads = std::max(1u, threads);
+  while (xs.size() > 1) {
+    std::size_t pairs = xs.size() / 2;
+    std::vector<compact_theta_sketch> next(pairs + xs.size() % 2);
+    std::vector<std::thread> ts;
+    auto work = [&](std::size_t w) {
+      for (std::size_t i = w; i < pairs; i += threads)
+        next[i] = theta_union(xs[2 * i], xs[2 * i + 1], k);
+    };
+    for (std::size_t w = 1; w < std::min<std::size_t>(threads, pairs); ++w)
+      ts.emplace_back(work, w);
+    work(0);
+    for (std::thread& t : ts)
+      t.join();
+    if (xs.size() % 2)
+      next.back() = std::move(xs.back());
+    xs = std::move(next);
+  }
+  theta_detail::trim(xs[0], k);
+  return std::move(xs[0]);
+}
+
+
+// Returns a sketch of the intersection of the sets sketched by a and b.
+inline compact_theta_sketch
+theta_intersection(compact_theta_sketch const& a, compact_theta_sketch const& b)
+{
+  theta_detail::check(a, b);
+  compact_theta_sketch r;
+  r.seed = a.seed;
+  r.theta = std::min(a.theta, b.theta);
+  auto ae = std::lower_bound(a.entries.begin(), a.entries.end(), r.theta);
+  auto be = std::lower_bound(b.entries.begin(), b.entries.end(), r.theta);
+  std::set_intersection(a.entries.begin(), ae, b.entries.begin(), be,
+                        std::back_inserter(r.entries));
+  return r;
+}
+
+
+// Returns a sketch of the difference of the sets sketched by a and b
+// (the objects in a but not in b).
+inline compact_theta_sketch
+theta_difference(compact_theta_sketch const& a, compact_theta_sketch const& b)
+{
+  theta_detail::check(a, b);
+  compact_theta_sketch r;
+  r.seed = a.seed;
+  r.theta = std::min(a.theta, b.theta);
+  auto ae = std::lower_bound(a.entries.begin(), a.entries.end(), r.theta);
+  auto be = std::lower_bound(b.entries.begin(), b.entries.end(), r.theta);
+  std::set_difference(a.entries.begin(), ae, b.entries.begin(), be,
+                      std::back_inserter(r.entries));
+  return r;
+}
+
+
+// -------------------------------------------------------------------------- //
+// Update sketches
+
+template<Hash_algorithm_64 H = fnv1a>
+class theta_sketch
+{
+  static constexpr std::uint64_t max_theta = compact_theta_sketch::max_theta;
+
+public:
+  // Create a sketch that retains about k digests.
+  explicit theta_sketch(std::size_t k = 4096, std::uint64_t seed = 0)
+    : k_(k), seed_(seed), hash_(H(seed))
+  {
+    if (k == 0 || k > (std::size_t(1) << 40))
+      throw std::invalid_argument("theta_sketch: bad size");
+    std::size_t n = 1;
+    while (n < 4 * k)
+      n *= 2;
+    slots_.assign(n, 0);
+  }
+
+  template<Hashable_with<H> T>
+  void insert(T const& t)
+  {
+    insert_digest(hash_mix(hash_(t)));
+  }
+
+  // Add the objects in [first, last), using up to the given number of
+  // threads. Each thread sketches part of the range, and the parts are
+  // merged.
+  template<Forward_iterator I>
+    requires Hashable_type<H, Value_type<I>>()
+  void insert(I first, I last, unsigned threads = 1)
+  {
+    std::size_t n = std::distance(first, last);
+    threads = std::max(1u, threads);
+    if (threads == 1 || n < 4 * k_) {
+      for (; first != last; ++first)
+        insert(*first);
+      return;
+    }
+    std::size_t chunk = (n + threads - 1) / threads;
+    std::vector<theta_sketch> parts;
+    for (std::size_t lo = 0; lo < n; lo += chunk)
+      parts.emplace_back(k_, seed_);
+    std::vector<std::thread> ts;
+    for (std::size_t p = 0; p < parts.size(); ++p) {
+      I lo = std::next(first, p * chunk);
+      I hi = std::next(lo, std::min(chunk, n - p * chunk));
+      ts.emplace_back([lo, hi, &parts, p] {
+        for (I i = lo; i != hi; ++i)
+          parts[p].insert(*i);
+      });
+    }
+    for (std::thread& t : ts)
+      t.join();
+    for (theta_sketch const& p : parts)
+      merge(p);
+  }
+
+  void insert_digest(std::uint64_t d)
+  {
+    if (d == 0 || d >= theta_)
+      return;
+    std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = d & mask; ; i = (i + 1) & mask) {
+      if (slots_[i] == d)
+        return;
+      if (slots_[i] == 0) {
+        slots_[i] = d;
+        break;
+      }
+    }
+    if (++count_ > 2 * k_)
+      rebuild();
+  }
+
+  // Add the objects of another sketch with the same seed.
+  void merge(theta_sketch const& x)
+  {
+    if (x.seed_ != seed_)
+      throw std::invalid_argument("theta_sketch: incompatible seeds");
+    if (x.theta_ < theta_) {
+      theta_ = x.theta_;
+      rebuild();
+    }
+    for (std::uint64_t d : x.slots_)
+      insert_digest(d);
+  }
+
+  // Returns the estimated number of distinct objects.
+  double estimate() const
+  {
+    return compact().estimate();
+  }
+
+  // Returns the compact form of the sketch, with at most k digests.
+  compact_theta_sketch compact() const
+  {
+    compact_theta_sketch s;
+    s.seed = seed_;
+    s.theta = theta_;
+    for (std::uint64_t d : slots_)
+      if (d != 0)
+        s.entries.push_back(d);
+    std::sort(s.entries.begin(), s.entries.end());
+    theta_detail::trim(s, k_);
+    return s;
+  }
+
+  void clear()
+  {
+    std::fill(slots_.begin(), slots_.end(), 0);
+    theta_ = max_theta;
+    count_ = 0;
+  }
+
+  std::size_t capacity() const { return k_; }
+  std::uint64_t seed() const { return seed_; }
+
+  // Returns the number of digests retained.
+  std::size_t size() const { return count_; }
+
+private:
+  // Drop the digests at or above theta. If more than k remain, lower
+  // theta to the k-th smallest and keep only those below it.
+  void rebuild()
+  {
+    std::vector<std::uint64_t> v;
+    v.reserve(count_);
+    for (std::uint64_t d : slots_)
+      if (d != 0 && d < theta_)
+        v.push_back(d);
+    if (v.size() > k_) {
+      std::nth_element(v.begin(), v.begin() + k_, v.end());
+      theta_ = v[k_];
+      v.resize(k_);
+    }
+    std::fill(slots_.begin(), slots_.end(), 0);
+    count_ = 0;
+    for (std::uint64_t d : v)
+      insert_digest(d);
+  }
+
+  std::size_t k_;
+  std::uint64_t seed_;
+  hash<H> hash_;
+  std::uint64_t theta_ = max_theta;
+  std::vector<std::uint64_t> slots_;
+  std::size_t count_ = 0;
+};
+
+
+} // namespace origin
+
+
+#endif